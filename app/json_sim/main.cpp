@@ -0,0 +1,68 @@
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "mbp/examples/registry.hpp"
+#include "mbp/sim/simulator.hpp"
+#include "nlohmann/json.hpp"
+
+static void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " <config> <trace> [<warm_instr> <sim_instr>] [<options>]\n"
+               "Simulates the predictors described in the JSON file <config>"
+               " without compiling them.\n"
+               "<config> contains the description of a predictor,"
+               " in the format of its metadata in the output of a simulation,"
+               " or an array of descriptions,"
+               " which are simulated in parallel.\n"
+               "The options are those of the example simulators."
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    PrintUsage(argv[0]);
+    return mbp::ERR_INPUT_DATA;
+  }
+  mbp::json config;
+  std::vector<std::unique_ptr<mbp::Predictor>> predictors;
+  try {
+    std::ifstream configFile(argv[1]);
+    if (!configFile) {
+      std::cerr << "Could not open '" << argv[1] << "'" << std::endl;
+      return mbp::ERR_INPUT_DATA;
+    }
+    configFile >> config;
+    if (config.is_array()) {
+      for (const mbp::json& description : config) {
+        predictors.push_back(mbp::MakePredictor(description));
+      }
+    } else {
+      predictors.push_back(mbp::MakePredictor(config));
+    }
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return mbp::ERR_INPUT_DATA;
+  }
+
+  // The common arguments follow the configuration.
+  argv[1] = argv[0];
+  mbp::SimArgs args = mbp::ParseCmdLineArgs(argc - 1, argv + 1);
+  try {
+    mbp::json output;
+    if (config.is_array()) {
+      std::vector<mbp::Predictor*> pointers;
+      for (const auto& p : predictors) pointers.push_back(p.get());
+      output = mbp::ParallelSim(pointers, args);
+    } else {
+      output = mbp::Simulate(predictors[0].get(), args);
+    }
+    mbp::WriteReport(std::cout, output, args.outputFormat);
+    std::cout.flush();
+    return output["errors"].empty() ? 0 : mbp::ERR_SIMULATION_ERROR;
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return mbp::ERR_SIMULATION_ERROR;
+  }
+}
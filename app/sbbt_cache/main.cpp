@@ -0,0 +1,90 @@
+#include <sys/stat.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mbp/sim/sbbt_columnar.hpp"
+
+static void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [--dir=<dir>] [--force] <trace>...\n"
+            << "Writes the columnar image of each <trace> (see"
+               " mbp::MakeColumnarTrace) to <dir>/<name>.sbbtc,\n"
+               "where <name> is the name of the trace without extension"
+               " and <dir> is the directory of the trace by default.\n"
+               "Images newer than their trace are kept unless --force"
+               " is given.\n"
+               "Prints the path of the image of each trace."
+            << std::endl;
+}
+
+/**
+ * Returns the path of the image of a trace.
+ */
+static std::string ImagePath(const std::string& trace, const std::string& dir) {
+  size_t slash = trace.rfind('/');
+  std::string name =
+      slash == std::string::npos ? trace : trace.substr(slash + 1);
+  // Removes .sbbt and the extension of the compression format, if any.
+  size_t extension = name.rfind(".sbbt");
+  if (extension != std::string::npos && extension != 0) {
+    name.erase(extension);
+  }
+  if (!dir.empty()) return dir + "/" + name + ".sbbtc";
+  return trace.substr(0, slash + 1) + name + ".sbbtc";
+}
+
+/**
+ * Tells whether the image exists and was modified after the trace.
+ */
+static bool UpToDate(const std::string& trace, const std::string& image) {
+  struct stat traceStat, imageStat;
+  if (stat(trace.c_str(), &traceStat) != 0 ||
+      stat(image.c_str(), &imageStat) != 0) {
+    return false;
+  }
+  return imageStat.st_mtim.tv_sec > traceStat.st_mtim.tv_sec ||
+         (imageStat.st_mtim.tv_sec == traceStat.st_mtim.tv_sec &&
+          imageStat.st_mtim.tv_nsec >= traceStat.st_mtim.tv_nsec);
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> traces;
+  std::string dir;
+  bool force = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--help") == 0) {
+      PrintUsage(argv[0]);
+      return 1;
+    } else if (strcmp(argv[i], "--force") == 0) {
+      force = true;
+    } else if (strncmp(argv[i], "--dir=", 6) == 0) {
+      dir = argv[i] + 6;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      std::cerr << "Unknown option '" << argv[i] << "'\n";
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      traces.push_back(argv[i]);
+    }
+  }
+  if (traces.empty()) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  try {
+    for (const std::string& trace : traces) {
+      std::string image = ImagePath(trace, dir);
+      if (force || !UpToDate(trace, image)) {
+        mbp::MakeColumnarTrace(trace, image);
+      }
+      std::cout << image << std::endl;
+    }
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
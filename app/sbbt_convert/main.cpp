@@ -0,0 +1,64 @@
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "mbp/sim/sbbt_reader.hpp"
+#include "mbp/sim/sbbt_writer.hpp"
+
+static void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [--sbbt-version=<version>] [--level=<level>]"
+               " <trace> <output>\n"
+               "Rewrites <trace> in the given version of the SBBT format"
+               " (2 by default) to <output>,\n"
+               "which must have extension .sbbt.zst and is compressed"
+               " with the given zstd level (19 by default)."
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> files;
+  unsigned version = 2;
+  int level = 19;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--help") == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+      } else if (strncmp(argv[i], "--sbbt-version=", 15) == 0) {
+        version = std::stoul(argv[i] + 15);
+      } else if (strncmp(argv[i], "--level=", 8) == 0) {
+        level = std::stoi(argv[i] + 8);
+      } else {
+        files.push_back(argv[i]);
+      }
+    }
+  } catch (std::exception const&) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (files.size() != 2) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  try {
+    mbp::SbbtReader reader(files[0]);
+    mbp::SbbtWriter writer(files[1], reader.numInstructions(),
+                           reader.numBranches(), level, version);
+    mbp::Branch b;
+    int64_t instrNum;
+    while ((instrNum = reader.nextBranch(b)) !=
+           std::numeric_limits<int64_t>::max()) {
+      writer.addBranch(instrNum, b.ip(), b.target(), b.isTaken(),
+                       b.opcode());
+    }
+    writer.close();
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
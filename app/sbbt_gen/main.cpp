@@ -0,0 +1,134 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mbp/sim/sbbt_writer.hpp"
+#include "mbp/sim/synthetic_trace.hpp"
+#include "nlohmann/json.hpp"
+
+static void PrintUsage(const char* program) {
+  std::cerr
+      << "Usage: " << program << " [<options>] <output> <branches>\n"
+      << "Writes a trace of <branches> branches of a synthetic workload"
+         " to <output>, which must have extension .sbbt.zst.\n"
+         "The same options always produce the same trace.\n"
+         "Options (see mbp::SyntheticTraceOptions):\n"
+         "  --seed=<n>                 Seed of the workload (0)\n"
+         "  --static-branches=<n>      Static branches (1024)\n"
+         "  --functions=<n>            Functions (16)\n"
+         "  --call-fraction=<f>        Fraction of calls (0.05)\n"
+         "  --indirect-fraction=<f>    Fraction of indirect calls (0.2)\n"
+         "  --max-indirect-targets=<n> Targets of indirect calls (4)\n"
+         "  --loop-fraction=<f>        Fraction of loop branches (0.2)\n"
+         "  --max-trip-count=<n>       Iterations of the loops (16)\n"
+         "  --correlated-fraction=<f>  Fraction of correlated branches (0.3)\n"
+         "  --correlation-depth=<n>    Outcomes they depend on (8)\n"
+         "  --min-bias=<f>             Bias of the rest of branches (0.9)\n"
+         "  --instr-per-branch=<f>     Mean instructions per branch (5)\n"
+         "  --level=<level>            zstd compression level (19)\n"
+         "  --sbbt-version=<version>   Version of the SBBT format (1)\n"
+         "  --print-model              Print the options as JSON\n";
+}
+
+int main(int argc, char** argv) {
+  mbp::SyntheticTraceOptions options;
+  std::vector<std::string> positional;
+  uint64_t numBranches = 0;
+  int level = 19;
+  unsigned version = 1;
+  bool printModel = false;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      std::string value = arg.substr(arg.find('=') + 1);
+      auto is = [&](const char* option) {
+        return arg.compare(0, strlen(option), option) == 0;
+      };
+      if (arg == "--help") {
+        PrintUsage(argv[0]);
+        return 1;
+      } else if (arg == "--print-model") {
+        printModel = true;
+      } else if (is("--seed=")) {
+        options.seed = std::stoull(value);
+      } else if (is("--static-branches=")) {
+        options.numStaticBranches = std::stoi(value);
+      } else if (is("--functions=")) {
+        options.numFunctions = std::stoi(value);
+      } else if (is("--call-fraction=")) {
+        options.callFraction = std::stod(value);
+      } else if (is("--indirect-fraction=")) {
+        options.indirectFraction = std::stod(value);
+      } else if (is("--max-indirect-targets=")) {
+        options.maxIndirectTargets = std::stoi(value);
+      } else if (is("--loop-fraction=")) {
+        options.loopFraction = std::stod(value);
+      } else if (is("--max-trip-count=")) {
+        options.maxTripCount = std::stoi(value);
+      } else if (is("--correlated-fraction=")) {
+        options.correlatedFraction = std::stod(value);
+      } else if (is("--correlation-depth=")) {
+        options.correlationDepth = std::stoi(value);
+      } else if (is("--min-bias=")) {
+        options.minBias = std::stod(value);
+      } else if (is("--instr-per-branch=")) {
+        options.instrPerBranch = std::stod(value);
+      } else if (is("--level=")) {
+        level = std::stoi(value);
+      } else if (is("--sbbt-version=")) {
+        version = std::stoul(value);
+      } else if (is("--")) {
+        std::cerr << "Unknown option '" << arg << "'\n";
+        PrintUsage(argv[0]);
+        return 1;
+      } else {
+        positional.push_back(arg);
+      }
+    }
+    if (positional.size() != 2) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    numBranches = std::stoull(positional[1]);
+  } catch (std::exception const&) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  try {
+    const std::string& output = positional[0];
+    if (numBranches == 0) {
+      std::cerr << "The trace must have at least one branch" << std::endl;
+      return 1;
+    }
+    if (printModel) {
+      std::cout << mbp::SyntheticTrace(options).metadata().dump(2)
+                << std::endl;
+    }
+    // The workload is deterministic, so it is generated twice:
+    // first to count the instructions of the header,
+    // which avoids recompressing the trace to add it at the end.
+    mbp::Branch b;
+    int64_t numInstructions = 0;
+    {
+      mbp::SyntheticTrace trace(options);
+      for (uint64_t i = 0; i < numBranches; ++i) {
+        numInstructions = trace.nextBranch(b);
+      }
+    }
+    mbp::SyntheticTrace trace(options);
+    mbp::SbbtWriter writer(output, numInstructions, numBranches, level,
+                           version);
+    for (uint64_t i = 0; i < numBranches; ++i) {
+      int64_t instrNum = trace.nextBranch(b);
+      writer.addBranch(instrNum, b.ip(), b.target(), b.isTaken(),
+                       b.opcode());
+    }
+    writer.close();
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mbp/sim/sbbt_index.hpp"
+
+static void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [--chunk=<branches>] [--level=<level>] <trace> [<output>]\n"
+               "Writes a seekable copy of <trace> to <output> and its index"
+               " to <output>.idx.\n"
+               "If <output> is not given, <trace> must be uncompressed"
+               " and only its index is written.\n"
+               "Seekable compressed traces must have extension .sbbt.zst."
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> files;
+  uint64_t chunkBranches = uint64_t{1} << 20;
+  int level = 19;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--help") == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+      } else if (strncmp(argv[i], "--chunk=", 8) == 0) {
+        chunkBranches = std::stoull(argv[i] + 8);
+      } else if (strncmp(argv[i], "--level=", 8) == 0) {
+        level = std::stoi(argv[i] + 8);
+      } else {
+        files.push_back(argv[i]);
+      }
+    }
+  } catch (std::exception const&) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (files.empty() || files.size() > 2) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  try {
+    const std::string& output = files.size() == 2 ? files[1] : files[0];
+    mbp::MakeSeekableTrace(files[0], output, chunkBranches, level);
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
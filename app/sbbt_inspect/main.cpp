@@ -17,6 +17,7 @@ int main(int argc, char** argv) {
     mbp::SbbtReader trace(argv[1]);
 
     json header = {
+        {"sbbt_version", trace.version()},
         {"num_instr", trace.numInstructions()},
         {"num_branches", trace.numBranches()},
     };
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <mbp/examples/mbp_examples.hpp>
+#include <mbp/sim/simulator.hpp>
+#include <mbp/sim/synthetic_trace.hpp>
+
+#include "batage_specs.hpp"
+#include "tage_specs.hpp"
+
+// Bytes touched to evict the predictor from the caches of the host.
+static constexpr size_t EVICTION_BYTES = 256 << 20;
+
+static void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [<options>] [<predictor>...]\n";
+  std::cerr << "Measures the time per branch of predict, train and track"
+               " of the example predictors (all of them by default)\n"
+               "on a synthetic workload, with cold and warm caches.\n";
+  std::cerr << "Options:\n";
+  std::cerr << "  --branches=<n>  Length of the workload (4000000)\n";
+  std::cerr << "  --seed=<n>      Seed of the workload (0)\n";
+  std::cerr << "  --windows=<n>   Number of windows of timed branches (32)\n";
+  std::cerr << "  --window=<n>    Branches of each window (1024)\n";
+}
+
+/**
+ * Evicts the data of the predictors from the caches of the host.
+ */
+static void EvictCaches() {
+  static std::vector<char> buffer(EVICTION_BYTES);
+  // Volatile, so that the writes are not optimized away.
+  volatile char* data = buffer.data();
+  for (size_t i = 0; i < buffer.size(); i += 64) data[i] = data[i] + 1;
+}
+
+/**
+ * Simulates the branches with the predictor without timing them.
+ */
+template <class P>
+static void Train(P& predictor, const std::vector<mbp::Branch>& branches) {
+  for (const mbp::Branch& b : branches) {
+    mbp::detail::SimulateBranch(predictor, b);
+  }
+}
+
+/**
+ * Simulates the branches with the predictor,
+ * timing the phases of every branch of numWindows windows
+ * of windowBranches branches, spread evenly over the branches.
+ * If evict, the caches of the host are evicted before each window,
+ * so that its first branches find the predictor out of the caches.
+ */
+template <class P>
+static mbp::json Pass(P& predictor, const std::vector<mbp::Branch>& branches,
+                      size_t numWindows, size_t windowBranches, bool evict) {
+  mbp::detail::PhaseProfiler profiler(1);
+  int64_t mispredictions = 0;
+  auto record = [&](bool mispredicted) { mispredictions += mispredicted; };
+  size_t n = branches.size();
+  size_t next = 0;
+  for (size_t w = 0; w < numWindows; ++w) {
+    size_t start = n * w / numWindows;
+    size_t end = std::min(start + windowBranches, n * (w + 1) / numWindows);
+    for (; next < start; ++next) {
+      record(mbp::detail::SimulateBranch(predictor, branches[next]));
+    }
+    if (evict) EvictCaches();
+    for (; next < end; ++next) {
+      mbp::detail::ProfileBranch(predictor, branches[next], profiler, record);
+    }
+  }
+  for (; next < n; ++next) {
+    record(mbp::detail::SimulateBranch(predictor, branches[next]));
+  }
+  mbp::json profile = profiler.report();
+  int64_t timedBranches = profile["num_branches"];
+  const mbp::json& phases = profile["phases"];
+  auto nsPerBranch = [&](const char* phase) {
+    return 1e9 * phases[phase]["seconds"].get<double>() / timedBranches;
+  };
+  double predictNs = nsPerBranch("predict");
+  double trainNs = nsPerBranch("train");
+  double trackNs = nsPerBranch("track");
+  return {
+      {"predict_ns_per_branch", predictNs},
+      {"train_ns_per_branch", trainNs},
+      {"track_ns_per_branch", trackNs},
+      {"ns_per_branch", predictNs + trainNs + trackNs},
+      {"timed_branches", timedBranches},
+      {"mispredictions", mispredictions},
+  };
+}
+
+int main(int argc, char** argv) {
+  int64_t numBranches = 4'000'000;
+  mbp::SyntheticTraceOptions workload;
+  int64_t numWindows = 32;
+  int64_t windowBranches = 1024;
+  std::vector<std::string> selected;
+  for (int i = 1; i < argc; ++i) {
+    char* endptr = nullptr;
+    if (strncmp(argv[i], "--branches=", 11) == 0) {
+      numBranches = strtoll(argv[i] + 11, &endptr, 0);
+    } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+      workload.seed = strtoull(argv[i] + 7, &endptr, 0);
+    } else if (strncmp(argv[i], "--windows=", 10) == 0) {
+      numWindows = strtoll(argv[i] + 10, &endptr, 0);
+    } else if (strncmp(argv[i], "--window=", 9) == 0) {
+      windowBranches = strtoll(argv[i] + 9, &endptr, 0);
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      PrintUsage(argv[0]);
+      return mbp::ERR_INPUT_DATA;
+    } else {
+      selected.emplace_back(argv[i]);
+    }
+    if (endptr != nullptr && *endptr != '\0') {
+      std::cerr << "Could not parse '" << argv[i] << "'\n";
+      return mbp::ERR_INPUT_DATA;
+    }
+  }
+  if (numBranches < 1 || numWindows < 1 || windowBranches < 1) {
+    PrintUsage(argv[0]);
+    return mbp::ERR_INPUT_DATA;
+  }
+
+  // The branches are generated in advance, so that only the predictors
+  // are measured.
+  mbp::SyntheticTrace trace(workload);
+  std::vector<mbp::Branch> branches(numBranches);
+  for (mbp::Branch& b : branches) trace.nextBranch(b);
+
+  std::vector<mbp::json> results;
+  std::vector<std::string> benchmarked;
+  auto bench = [&](const std::string& name, auto makePredictor) {
+    if (!selected.empty() &&
+        std::find(selected.begin(), selected.end(), name) == selected.end()) {
+      return;
+    }
+    // Both passes start from the same state,
+    // that of a predictor trained with the workload.
+    auto coldPredictor = makePredictor();
+    auto warmPredictor = makePredictor();
+    Train(*coldPredictor, branches);
+    Train(*warmPredictor, branches);
+    mbp::json cold =
+        Pass(*coldPredictor, branches, numWindows, windowBranches, true);
+    mbp::json warm =
+        Pass(*warmPredictor, branches, numWindows, windowBranches, false);
+    results.push_back({
+        {"name", name},
+        {"predictor", warmPredictor->metadata_stats()},
+        {"cold", std::move(cold)},
+        {"warm", std::move(warm)},
+    });
+    benchmarked.push_back(name);
+  };
+
+  // The predictors of the example simulators, created like in src/main.cpp.
+#define BENCH_PREDICTOR(name, ...)                 \
+  bench(name, [] {                                 \
+    using P = decltype(__VA_ARGS__);               \
+    return std::unique_ptr<P>(new P(__VA_ARGS__)); \
+  });
+#include "bench_predictors.inc"
+#undef BENCH_PREDICTOR
+
+  std::vector<std::string> errors;
+  for (const std::string& name : selected) {
+    if (std::find(benchmarked.begin(), benchmarked.end(), name) ==
+        benchmarked.end()) {
+      errors.push_back("Unknown predictor '" + name + "'");
+    }
+  }
+  mbp::json output = {
+      {"metadata",
+       {
+           {"simulator", "MBPlib bench"},
+           {"simulator_version", "v0.1.0"},
+           {"num_branches", numBranches},
+           {"num_windows", numWindows},
+           {"window_branches", windowBranches},
+           {"workload", trace.metadata()},
+       }},
+      {"results", std::move(results)},
+      {"errors", std::move(errors)},
+  };
+  std::cout << std::setw(2) << output << std::endl;
+  return output["errors"].empty() ? 0 : mbp::ERR_SIMULATION_ERROR;
+}
@@ -9,5 +9,5 @@ auto branchPredictor0 = PREDICTOR0;
 auto branchPredictor1 = PREDICTOR1;
 
 int main(int argc, char** argv) {
-  return mbp::CompareMain(argc, argv, {&branchPredictor0, &branchPredictor1});
+  return mbp::CompareMain(argc, argv, branchPredictor0, branchPredictor1);
 }
@@ -7,5 +7,5 @@
 static auto branchPredictor = PREDICTOR;
 
 int main(int argc, char** argv) {
-  return mbp::SimMain(argc, argv, &branchPredictor);
+  return mbp::SimMain(argc, argv, branchPredictor);
 }
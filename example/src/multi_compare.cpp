@@ -0,0 +1,16 @@
+#include <mbp/examples/mbp_examples.hpp>
+#include <mbp/sim/simulator.hpp>
+
+#include "batage_specs.hpp"
+#include "tage_specs.hpp"
+
+int main(int argc, char** argv) {
+  static mbp::Gshare<25, 18> gshare;
+  static mbp::Twobcgskew<> twobcgskew;
+  static mbp::HashedPerceptron<4, 16, 12, 18> hashedPerceptron;
+  static mbp::Tage tage{{TAGE_SPECS.begin(), TAGE_SPECS.end()}};
+  static mbp::Batage batage{{BATAGE_SPECS.begin(), BATAGE_SPECS.end()},
+                            BATAGE_SEED};
+  return mbp::MultiCompareMain(
+      argc, argv, {&gshare, &twobcgskew, &hashedPerceptron, &tage, &batage});
+}
@@ -1,4 +1,3 @@
-#include <iomanip>
 #include <iostream>
 #include <mbp/examples/mbp_examples.hpp>
 #include <mbp/sim/simulator.hpp>
@@ -153,6 +152,6 @@ int main(int argc, char** argv) {
   mbp::SimArgs args = mbp::ParseCmdLineArgs(argc, argv);
   batages.resize(NUM_PREDICTORS_TESTED);
   mbp::json output = mbp::ParallelSim(batages, args);
-  std::cout << std::setw(2) << output << std::endl;
+  mbp::WriteReport(std::cout, output, args.outputFormat);
   return 0;
 }
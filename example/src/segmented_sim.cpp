@@ -0,0 +1,11 @@
+#include <mbp/examples/mbp_examples.hpp>
+#include <mbp/sim/simulator.hpp>
+
+#include "batage_specs.hpp"
+#include "tage_specs.hpp"
+
+int main(int argc, char** argv) {
+  return mbp::SegmentedSimMain(argc, argv, [] {
+    return std::unique_ptr<mbp::Predictor>(new auto(PREDICTOR));
+  });
+}
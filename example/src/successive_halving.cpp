@@ -0,0 +1,34 @@
+#include <cmath>
+#include <mbp/examples/mbp_examples.hpp>
+#include <mbp/sim/simulator.hpp>
+
+#include "batage_specs.hpp"
+
+/**
+ * Returns the specs of BATAGE_SPECS with the history lengths scaled by
+ * ghistScale and the tag widths increased by tagDelta.
+ */
+static std::vector<mbp::Batage::TableSpec> Variant(double ghistScale,
+                                                   int tagDelta) {
+  std::vector<mbp::Batage::TableSpec> specs;
+  for (auto [ghistLen, idxWidth, tagWidth] : BATAGE_SPECS) {
+    uint32_t scaledLen = std::lround(ghistLen * ghistScale);
+    uint32_t newTagWidth = tagWidth == 0 ? 0 : tagWidth + tagDelta;
+    specs.push_back({scaledLen, idxWidth, newTagWidth});
+  }
+  return specs;
+}
+
+int main(int argc, char** argv) {
+  // Search the history lengths and tag widths of BATAGE_SPECS.
+  std::vector<mbp::PredictorFactory> candidates;
+  for (double ghistScale : {0.5, 0.75, 1.0, 1.25, 1.5, 2.0}) {
+    for (int tagDelta : {-2, 0, 2}) {
+      candidates.emplace_back([ghistScale, tagDelta] {
+        return std::make_unique<mbp::Batage>(Variant(ghistScale, tagDelta),
+                                             BATAGE_SEED);
+      });
+    }
+  }
+  return mbp::SuccessiveHalvingMain(argc, argv, candidates);
+}
@@ -0,0 +1,27 @@
+#include <mbp/examples/mbp_examples.hpp>
+#include <mbp/sim/simulator.hpp>
+
+#include "batage_specs.hpp"
+#include "tage_specs.hpp"
+
+/**
+ * Returns a factory of copies of the given predictor.
+ */
+template <class P>
+static mbp::PredictorFactory Factory(P predictor) {
+  return [predictor] { return std::make_unique<P>(predictor); };
+}
+
+int main(int argc, char** argv) {
+  return mbp::SuiteMain(
+      argc, argv,
+      {
+          Factory(mbp::Bimodal<18>{}),
+          Factory(mbp::Gshare<25, 18>{}),
+          Factory(mbp::Twobcgskew<>{}),
+          Factory(mbp::HashedPerceptron<4, 16, 12, 18>{}),
+          Factory(mbp::Tage{{TAGE_SPECS.begin(), TAGE_SPECS.end()}}),
+          Factory(mbp::Batage{{BATAGE_SPECS.begin(), BATAGE_SPECS.end()},
+                              BATAGE_SEED}),
+      });
+}
@@ -36,9 +36,18 @@ class Branch {
     CALL = 0b1000,
   };
 
+  // Value of staticId() for branches read from traces
+  // that do not store the identifiers.
+  static constexpr uint32_t NO_STATIC_ID = 0xFFFFFFFF;
+
   Branch() = default;
-  constexpr Branch(uint64_t ip, uint64_t target, OpCode opcode, uint8_t outcome)
-      : ip_(ip), target_(target), opcode_(opcode), outcome_(outcome) {}
+  constexpr Branch(uint64_t ip, uint64_t target, OpCode opcode, uint8_t outcome,
+                   uint32_t staticId = NO_STATIC_ID)
+      : ip_(ip),
+        target_(target),
+        opcode_(opcode),
+        outcome_(outcome),
+        staticId_(staticId) {}
 
   // Returns the branch program address.
   constexpr uint64_t ip() const { return ip_; }
@@ -47,7 +56,7 @@ class Branch {
   // Tells whether the branch is taken or not, according to the trace.
   constexpr bool isTaken() const { return outcome_; }
   // Returns the branch opcode.
-  constexpr OpCode opcode() const { return opcode_; }
+  constexpr OpCode opcode() const { return static_cast<OpCode>(opcode_); }
   // Tells whether the branch is conditional or not,
   // according to its opcode.
   constexpr bool isConditional() const { return (opcode_ & CND) != 0; }
@@ -56,12 +65,19 @@ class Branch {
   constexpr bool isIndirect() const { return (opcode_ & IND) != 0; }
   // Returns the base type of the branch opcode.
   constexpr OpCode type() const { return static_cast<OpCode>(opcode_ & TYPE); }
+  // Returns the dense identifier of the branch program address,
+  // assigned by the trace reader (see SbbtReader::numStaticIds()),
+  // or NO_STATIC_ID if the trace does not store them (SBBT v1).
+  // Identifiers start at 0, so they can index arrays instead of hash tables.
+  constexpr uint32_t staticId() const { return staticId_; }
 
  private:
   uint64_t ip_;
   uint64_t target_;
-  OpCode opcode_;
+  // Stored in a byte, so that the identifier fits in the padding.
+  uint8_t opcode_;
   uint8_t outcome_;
+  uint32_t staticId_;
 
   friend std::ostream& operator<<(std::ostream& os, const Branch& b);
 };
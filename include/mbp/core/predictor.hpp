@@ -2,6 +2,7 @@
 #define MBP_PREDICTOR_HPP_
 
 #include <cstdint>
+#include <iosfwd>
 
 #include "mbp/core/branch.hpp"
 #include "nlohmann/json_fwd.hpp"
@@ -50,6 +51,26 @@ class Predictor {
    * Resets all execution statistics to their default value.
    */
   virtual void clear_execution_stats() {}
+
+  /**
+   * Writes the state of the predictor to a stream.
+   *
+   * Together with deserialize, it allows taking snapshots of a predictor,
+   * e.g., to skip the warmup of later simulations (see SimArgs).
+   * The configuration of the predictor need not be stored,
+   * since snapshots are only restored into predictors
+   * with the same metadata_stats().
+   * The default implementation throws std::logic_error.
+   */
+  virtual void serialize(std::ostream& os) const;
+
+  /**
+   * Restores the state written by serialize.
+   *
+   * After the call, the predictor must behave exactly like the serialized one.
+   * The default implementation throws std::logic_error.
+   */
+  virtual void deserialize(std::istream& is);
 };
 
 }  // namespace mbp
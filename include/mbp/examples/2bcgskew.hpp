@@ -7,6 +7,7 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
@@ -21,7 +22,7 @@ namespace mbp {
  */
 template <int BT = 15, int G0T = 16, int G1T = 16, int MT = 15, int G0H = 17,
           int G1H = 27, int MH = 20>
-struct Twobcgskew : Predictor {
+struct Twobcgskew final : Predictor {
   // Components
   std::array<i2, (1 << BT)> bim;
   std::array<i2, (1 << G0T)> g0;
@@ -115,6 +116,16 @@ struct Twobcgskew : Predictor {
     tracked = true;
   }
 
+  void serialize(std::ostream& os) const override {
+    Serialize(os, bim, g0, g1, meta, ghist);
+  }
+
+  void deserialize(std::istream& is) override {
+    Deserialize(is, bim, g0, g1, meta, ghist);
+    // The saved values are recomputed by the next prediction.
+    tracked = true;
+  }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib 2bcgskew"},
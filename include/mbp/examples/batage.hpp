@@ -9,11 +9,12 @@
 #include "mbp/utils/arithmetic.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
 
-struct Batage : Predictor {
+struct Batage final : Predictor {
   struct Entry {
     uint32_t tag;
     BatageCtr<3> ctr;
@@ -39,6 +40,7 @@ struct Batage : Predictor {
   std::vector<uint32_t> idxWidth;
   std::vector<uint32_t> tagWidth;
   // Random Number Generators
+  int seed;
   std::mt19937 rng;
   std::uniform_int_distribution<std::mt19937::result_type> catRng;
   std::uniform_int_distribution<std::mt19937::result_type> decayRng;
@@ -63,6 +65,7 @@ struct Batage : Predictor {
       : ghistLen(),
         idxWidth(),
         tagWidth(),
+        seed(seed),
         rng(seed),
         catRng(0, MIN_AP - 1),
         decayRng(0, 3),
@@ -196,6 +199,17 @@ struct Batage : Predictor {
     updatedGhist = true;
   }
 
+  void serialize(std::ostream& os) const override {
+    // The distributions do not keep state between calls.
+    Serialize(os, rng, table, idxFold, tagFold, ghist, ghistIdx, cat);
+  }
+
+  void deserialize(std::istream& is) override {
+    Deserialize(is, rng, table, idxFold, tagFold, ghist, ghistIdx, cat);
+    // The saved entries may point to the old tables, so recompute them.
+    updatedGhist = true;
+  }
+
   json metadata_stats() const override {
     std::vector<json> tableJson;
     for (size_t i = 0; i < table.size(); ++i) {
@@ -210,6 +224,7 @@ struct Batage : Predictor {
     return {
         {"name", "MBPlib Batage"},
         {"tables", tableJson},
+        {"seed", seed},
     };
   }
 };
@@ -7,12 +7,13 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
 
 template <int T = 14>
-struct Bimodal : Predictor {
+struct Bimodal final : Predictor {
   std::array<i2, (1 << T)> table;
 
   static constexpr uint64_t hash(uint64_t ip) { return ip & ((1ULL << T) - 1); }
@@ -25,6 +26,10 @@ struct Bimodal : Predictor {
 
   void track(const Branch& b) override {}
 
+  void serialize(std::ostream& os) const override { Serialize(os, table); }
+
+  void deserialize(std::istream& is) override { Deserialize(is, table); }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Bimodal"},
@@ -34,7 +39,7 @@ struct Bimodal : Predictor {
 };
 
 template <int N, int T = 14>
-struct Nmodal : Predictor {
+struct Nmodal final : Predictor {
   std::array<SatCtr<N>, (1 << T)> table;
 
   static constexpr uint64_t hash(uint64_t ip) { return ip & ((1ULL << T) - 1); }
@@ -47,6 +52,10 @@ struct Nmodal : Predictor {
 
   void track(const Branch& b) override {}
 
+  void serialize(std::ostream& os) const override { Serialize(os, table); }
+
+  void deserialize(std::istream& is) override { Deserialize(is, table); }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Nmodal"},
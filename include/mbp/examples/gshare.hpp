@@ -7,6 +7,7 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
@@ -19,7 +20,7 @@ namespace mbp {
  * @param IGNORE_UCD Whether to ignore unconditional branches for the history.
  */
 template <int H = 15, int T = 14, bool IGNORE_UCD = false>
-struct Gshare : Predictor {
+struct Gshare final : Predictor {
   std::array<i2, (1 << T)> table;
   std::bitset<H> ghist;
 
@@ -42,6 +43,12 @@ struct Gshare : Predictor {
     ghist[0] = b.isTaken();
   }
 
+  void serialize(std::ostream& os) const override {
+    Serialize(os, table, ghist);
+  }
+
+  void deserialize(std::istream& is) override { Deserialize(is, table, ghist); }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Gshare"},
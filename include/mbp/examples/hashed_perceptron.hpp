@@ -7,12 +7,13 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
 
 template <int MINH, int NUMT, int T, int MISP_THRESH = 18>
-struct HashedPerceptron : Predictor {
+struct HashedPerceptron final : Predictor {
   static constexpr double phi = (1 + sqrt(5.0)) / 2;
   static constexpr double GEOM_RATIO = std::pow(phi, 1 / phi);
   static constexpr int H =
@@ -33,7 +34,10 @@ struct HashedPerceptron : Predictor {
   uint64_t predictedIp;
 
   HashedPerceptron()
-      : theta(10),
+      : component(),
+        ghist(),
+        ghistIdx(0),
+        theta(10),
         misp(0),
         sum(0),
         prediction(false),
@@ -94,6 +98,16 @@ struct HashedPerceptron : Predictor {
     tracked = true;
   }
 
+  void serialize(std::ostream& os) const override {
+    Serialize(os, component, ghistFold, ghist, ghistIdx, theta, misp);
+  }
+
+  void deserialize(std::istream& is) override {
+    Deserialize(is, component, ghistFold, ghist, ghistIdx, theta, misp);
+    // The saved values are recomputed by the next prediction.
+    tracked = true;
+  }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Hashed Perceptron"},
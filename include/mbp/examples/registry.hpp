@@ -0,0 +1,56 @@
+#ifndef MBP_EXAMPLES_REGISTRY_HPP_
+#define MBP_EXAMPLES_REGISTRY_HPP_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mbp/core/predictor.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+/**
+ * Function that creates a predictor from its description.
+ */
+using PredictorBuilder =
+    std::function<std::unique_ptr<Predictor>(const json& description)>;
+
+/**
+ * Creates a predictor from its description, without recompiling.
+ *
+ * The description is a JSON object in the format of the metadata_stats()
+ * of the predictor, whose "name" selects the builder.
+ * All the example predictors are registered, and the parameters
+ * with default values in their templates can be omitted.
+ * Tournaments contain the descriptions of their components,
+ * which are created recursively and called through the vtable.
+ *
+ * The predictors with template parameters are precompiled
+ * for the parameters of the example simulators and for a dense range
+ * of table sizes and history lengths.
+ * The rest of parameters are simulated by classes whose sizes
+ * are set at runtime, which give the same results and snapshots
+ * but are slower.
+ *
+ * @throws std::invalid_argument if the description is not valid.
+ */
+std::unique_ptr<Predictor> MakePredictor(const json& description);
+
+/**
+ * Registers the builder of the predictors described with the given name,
+ * replacing the previous one, if any.
+ *
+ * It must not be called concurrently with MakePredictor.
+ */
+void RegisterPredictor(const std::string& name, PredictorBuilder builder);
+
+/**
+ * Returns the names of the registered predictors.
+ */
+std::vector<std::string> RegisteredPredictors();
+
+}  // namespace mbp
+
+#endif  // MBP_EXAMPLES_REGISTRY_HPP_
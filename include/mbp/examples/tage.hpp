@@ -6,11 +6,12 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/arithmetic.hpp"
 #include "mbp/utils/indexing.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
 
-struct Tage : Predictor {
+struct Tage final : Predictor {
   struct Entry {
     uint32_t tag;
     int32_t ctr;
@@ -61,6 +62,7 @@ struct Tage : Predictor {
         tagFold(),
         ghist(),
         ghistIdx(0),
+        meta(),
         entry(specs.size()),
         tag(specs.size()),
         entriesIp(0),
@@ -161,6 +163,16 @@ struct Tage : Predictor {
     updatedGhist = true;
   }
 
+  void serialize(std::ostream& os) const override {
+    Serialize(os, table, idxFold, tagFold, ghist, ghistIdx, meta);
+  }
+
+  void deserialize(std::istream& is) override {
+    Deserialize(is, table, idxFold, tagFold, ghist, ghistIdx, meta);
+    // The saved entries may point to the old tables, so recompute them.
+    updatedGhist = true;
+  }
+
   json metadata_stats() const override {
     std::vector<json> tableJson;
     for (size_t i = 0; i < table.size(); ++i) {
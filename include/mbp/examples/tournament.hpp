@@ -8,12 +8,13 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
 
 template <typename BP0, typename BP1, int T = 14>
-struct BimodalTournament : Predictor {
+struct BimodalTournament final : Predictor {
   std::array<i2, (1 << T)> table;
   BP0 bp0;
   BP1 bp1;
@@ -42,6 +43,18 @@ struct BimodalTournament : Predictor {
     bp1.track(b);
   }
 
+  void serialize(std::ostream& os) const override {
+    Serialize(os, table);
+    bp0.serialize(os);
+    bp1.serialize(os);
+  }
+
+  void deserialize(std::istream& is) override {
+    Deserialize(is, table);
+    bp0.deserialize(is);
+    bp1.deserialize(is);
+  }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Bimodal Tournament"},
@@ -53,7 +66,7 @@ struct BimodalTournament : Predictor {
 };
 
 template <typename BP0, typename BP1, int H = 10, int T = 14>
-struct GshareTournament : Predictor {
+struct GshareTournament final : Predictor {
   static_assert(H + (T - (H % T)) < sizeof(unsigned long long) * 8);
   std::array<i3, (1 << T)> table;
   std::bitset<H> ghist;
@@ -88,6 +101,18 @@ struct GshareTournament : Predictor {
     ghist[0] = b.isTaken();
   }
 
+  void serialize(std::ostream& os) const override {
+    Serialize(os, table, ghist);
+    bp0.serialize(os);
+    bp1.serialize(os);
+  }
+
+  void deserialize(std::istream& is) override {
+    Deserialize(is, table, ghist);
+    bp0.deserialize(is);
+    bp1.deserialize(is);
+  }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Gshare Tournament"},
@@ -99,7 +124,7 @@ struct GshareTournament : Predictor {
   }
 };
 
-struct TournamentPred : Predictor {
+struct TournamentPred final : Predictor {
   std::unique_ptr<Predictor> meta;
   std::unique_ptr<Predictor> bp0;
   std::unique_ptr<Predictor> bp1;
@@ -144,6 +169,20 @@ struct TournamentPred : Predictor {
     tracked = true;
   }
 
+  void serialize(std::ostream& os) const override {
+    meta->serialize(os);
+    bp0->serialize(os);
+    bp1->serialize(os);
+  }
+
+  void deserialize(std::istream& is) override {
+    meta->deserialize(is);
+    bp0->deserialize(is);
+    bp1->deserialize(is);
+    // The cached predictions are recomputed by the next prediction.
+    tracked = true;
+  }
+
   json metadata_stats() const override {
     return {
         {"name", "MBPlib Tournament"},
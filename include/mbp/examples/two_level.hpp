@@ -7,6 +7,7 @@
 #include "mbp/core/predictor.hpp"
 #include "mbp/utils/indexing.hpp"
 #include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
@@ -39,7 +40,7 @@ namespace mbp {
  * that the proportion of branch instructions is roughly 1/7.
  */
 template <int HLEN, int HNUM, int HSET, int PNUM, int PSET>
-struct TwoLevel : Predictor {
+struct TwoLevel final : Predictor {
   std::array<std::bitset<HLEN>, (1 << HNUM)> bhr;
   std::array<i2, (1 << (PNUM + HLEN))> phr;
 
@@ -63,6 +64,10 @@ struct TwoLevel : Predictor {
     bhr[bhrHash(b.ip())][0] = b.isTaken();
   }
 
+  void serialize(std::ostream& os) const override { Serialize(os, bhr, phr); }
+
+  void deserialize(std::istream& is) override { Deserialize(is, bhr, phr); }
+
   json metadata_stats() const override {
     // clang-format off
     return {
@@ -0,0 +1,183 @@
+#ifndef MBP_IP_TABLE_HPP_
+#define MBP_IP_TABLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace mbp {
+
+/**
+ * Hash table from instruction addresses to values of type T.
+ *
+ * It is a flat table with open addressing and linear probing,
+ * so that a lookup usually touches a single cache line,
+ * unlike node-based maps such as std::unordered_map.
+ * The values are value-initialized (i.e., zero for counters)
+ * the first time they are accessed and are never erased.
+ * References to values are invalidated when the table grows.
+ */
+template <class T>
+class IpTable {
+ public:
+  struct Entry {
+    uint64_t ip;
+    T value;
+  };
+
+  /**
+   * Iterator over the entries of the table, in no particular order.
+   */
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Entry*;
+    using reference = const Entry&;
+
+    const_iterator(const IpTable* table, size_t idx)
+        : table_(table), idx_(idx) {
+      skipEmpty();
+    }
+
+    reference operator*() const { return table_->entries_[idx_]; }
+    pointer operator->() const { return &table_->entries_[idx_]; }
+
+    const_iterator& operator++() {
+      ++idx_;
+      skipEmpty();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const const_iterator& rhs) const {
+      return idx_ == rhs.idx_;
+    }
+    bool operator!=(const const_iterator& rhs) const {
+      return idx_ != rhs.idx_;
+    }
+
+   private:
+    void skipEmpty() {
+      while (idx_ < table_->entries_.size() && !table_->occupied(idx_)) {
+        ++idx_;
+      }
+    }
+
+    const IpTable* table_;
+    size_t idx_;
+  };
+
+  /**
+   * Creates a table that can hold expectedSize entries without growing.
+   */
+  explicit IpTable(size_t expectedSize = 0) : size_(0), hasZero_(false) {
+    size_t capacity = MIN_CAPACITY;
+    while (capacity < 2 * expectedSize) capacity *= 2;
+    allocate(capacity);
+  }
+
+  /**
+   * Returns the value of ip, inserting it if it is not in the table.
+   */
+  T& operator[](uint64_t ip) {
+    if (ip == EMPTY) {
+      // The empty marker is stored in a slot after the probed ones.
+      if (!hasZero_) {
+        hasZero_ = true;
+        size_ += 1;
+      }
+      return entries_[mask_ + 1].value;
+    }
+    for (size_t idx = slot(ip);; idx = (idx + 1) & mask_) {
+      Entry& entry = entries_[idx];
+      if (entry.ip == ip) return entry.value;
+      if (entry.ip == EMPTY) {
+        // Keep the load factor under 1/2, so that probes are short.
+        if (2 * (size_ + 1) > mask_ + 1) {
+          grow();
+          return (*this)[ip];
+        }
+        entry.ip = ip;
+        size_ += 1;
+        return entry.value;
+      }
+    }
+  }
+
+  /**
+   * Returns the value of ip, or nullptr if it is not in the table.
+   */
+  const T* find(uint64_t ip) const {
+    if (ip == EMPTY) return hasZero_ ? &entries_[mask_ + 1].value : nullptr;
+    for (size_t idx = slot(ip);; idx = (idx + 1) & mask_) {
+      const Entry& entry = entries_[idx];
+      if (entry.ip == ip) return &entry.value;
+      if (entry.ip == EMPTY) return nullptr;
+    }
+  }
+
+  /**
+   * Returns the number of entries.
+   */
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, entries_.size()); }
+
+ private:
+  static constexpr uint64_t EMPTY = 0;
+  static constexpr size_t MIN_CAPACITY = 16;
+
+  void allocate(size_t capacity) {
+    // One more entry for the ip equal to EMPTY.
+    entries_.assign(capacity + 1, Entry{});
+    mask_ = capacity - 1;
+    shift_ = 64;
+    for (size_t c = capacity; c > 1; c /= 2) shift_ -= 1;
+  }
+
+  /**
+   * Returns the first slot probed for ip.
+   */
+  size_t slot(uint64_t ip) const {
+    // Fibonacci hashing: the high bits of the product depend on all the bits
+    // of the ip, including the low ones, which vary the most.
+    return (ip * 0x9E3779B97F4A7C15ULL) >> shift_;
+  }
+
+  bool occupied(size_t idx) const {
+    return idx <= mask_ ? entries_[idx].ip != EMPTY : hasZero_;
+  }
+
+  void grow() {
+    std::vector<Entry> old = std::move(entries_);
+    allocate(2 * (mask_ + 1));
+    entries_.back() = old.back();
+    for (size_t i = 0; i + 1 < old.size(); ++i) {
+      if (old[i].ip == EMPTY) continue;
+      size_t idx = slot(old[i].ip);
+      while (entries_[idx].ip != EMPTY) idx = (idx + 1) & mask_;
+      entries_[idx] = old[i];
+    }
+  }
+
+  std::vector<Entry> entries_;
+  size_t mask_;
+  unsigned shift_;
+  size_t size_;
+  bool hasZero_;
+};
+
+}  // namespace mbp
+
+#endif  // MBP_IP_TABLE_HPP_
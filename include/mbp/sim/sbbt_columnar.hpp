@@ -0,0 +1,37 @@
+#ifndef MBP_SBBT_COLUMNAR_HPP_
+#define MBP_SBBT_COLUMNAR_HPP_
+
+#include <cstdint>
+#include <string>
+
+namespace mbp {
+
+/**
+ * Writes the columnar image of a trace.
+ *
+ * A columnar trace (extension .sbbtc, columnar format version 2) stores
+ * the branches of a trace already decoded and uncompressed,
+ * in one aligned array per field: ip, target, opcode and outcome,
+ * instruction delta and static identifier.
+ * After the columns come the instruction number of every
+ * checkpointBranches branches, so it is always seekable,
+ * and the table of the ip of each static identifier.
+ * SbbtReader maps it and copies the arrays,
+ * so reading it costs neither decompression nor decoding,
+ * at the price of about 23 bytes per branch and 8 bytes per static branch
+ * on disk.
+ * The static identifiers of a v1 trace, which does not store them,
+ * are assigned here in order of appearance.
+ *
+ * The image is written to a temporary file and then renamed,
+ * so readers never see a partial image.
+ *
+ * @param input Trace in any format supported by SbbtReader.
+ * @param output Path of the image, which must have extension .sbbtc.
+ */
+void MakeColumnarTrace(const std::string& input, const std::string& output,
+                       uint64_t checkpointBranches = uint64_t{1} << 16);
+
+}  // namespace mbp
+
+#endif  // MBP_SBBT_COLUMNAR_HPP_
@@ -0,0 +1,82 @@
+#ifndef MBP_SBBT_INDEX_HPP_
+#define MBP_SBBT_INDEX_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mbp {
+
+/**
+ * Index of a seekable SBBT trace.
+ *
+ * A seekable trace is divided in chunks of consecutive branches
+ * that can be decoded independently.
+ * For uncompressed traces any branch can start a chunk,
+ * while compressed traces (only .sbbt.zst is supported)
+ * must store each chunk in its own zstd frame.
+ * The index is stored next to the trace, in the file `<trace>.idx`,
+ * and maps the first instruction of each chunk to its byte offset.
+ */
+class SbbtIndex {
+ public:
+  struct Entry {
+    // Offset of the chunk in the trace file.
+    uint64_t offset;
+    // Number of branches before the chunk.
+    uint64_t branchNum;
+    // Instruction number of the last branch before the chunk.
+    int64_t instrNum;
+  };
+
+  /**
+   * Returns the path of the index of a trace.
+   */
+  static std::string PathFor(const std::string& trace) {
+    return trace + ".idx";
+  }
+
+  /**
+   * Loads an index from a file.
+   */
+  static SbbtIndex Load(const std::string& path);
+
+  /**
+   * Stores the index in a file.
+   */
+  void save(const std::string& path) const;
+
+  /**
+   * Returns the chunk from which to read to find
+   * the first branch with an instruction number greater or equal to instrNum.
+   *
+   * That is the last chunk whose previous branch is before instrNum.
+   * The index must not be empty.
+   */
+  const Entry& find(int64_t instrNum) const;
+
+  // Trace header data, used to check that the index matches the trace.
+  uint64_t numInstructions = 0;
+  uint64_t numBranches = 0;
+  std::vector<Entry> entries;
+};
+
+/**
+ * Writes a seekable copy of a trace and its index.
+ *
+ * The output must have extension .sbbt or .sbbt.zst.
+ * If the input and output are the same uncompressed trace,
+ * only the index is written. Otherwise, the copy is written
+ * to a temporary file that replaces the output when it is complete,
+ * so the output can also be the input.
+ *
+ * @param chunkBranches Number of branches per chunk.
+ * @param level Compression level of the zstd frames.
+ */
+void MakeSeekableTrace(const std::string& input, const std::string& output,
+                       uint64_t chunkBranches = uint64_t{1} << 20,
+                       int level = 19);
+
+}  // namespace mbp
+
+#endif  // MBP_SBBT_INDEX_HPP_
@@ -2,9 +2,12 @@
 #define MBP_SBBT_READER_HPP_
 
 #include <array>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "mbp/core/predictor.hpp"
+#include "mbp/sim/sbbt_index.hpp"
 
 #ifdef __GNUC__
 static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
@@ -19,18 +22,66 @@ static_assert(__LITTLE_ENDIAN__, "System must be little endian\n");
 
 namespace mbp {
 
+class TraceSource;
+struct SbbtDictionary;
+
+/**
+ * Options for the construction of an SbbtReader.
+ */
+struct SbbtReaderOptions {
+  // Decompress the trace in a background thread that reads ahead.
+  // Only compressed traces are affected, since uncompressed ones are mapped.
+  bool prefetch = false;
+};
+
+/**
+ * Arrays where to store a batch of branches, one array per field.
+ *
+ * This layout (a structure of arrays) allows decoding several branches
+ * at the same time with vector instructions.
+ */
+struct BranchArrays {
+  uint64_t* ip;
+  uint64_t* target;
+  // Values of Branch::OpCode.
+  uint8_t* opcode;
+  uint8_t* outcome;
+  int64_t* instrNum;
+  // Values of Branch::staticId(), which are not stored if it is null.
+  uint32_t* staticId;
+};
+
 /**
  * Trace reader for the SBBT format.
+ *
+ * Both versions of the format are supported: v1, where each branch record
+ * holds the ip, target and opcode of the branch (16 bytes),
+ * and v2, where each record holds an index into a dictionary
+ * of ips, targets and opcodes stored after the header (8 bytes).
+ *
+ * Uncompressed traces (extension .sbbt) are memory-mapped
+ * and their branches are decoded in place.
+ * Compressed traces are decompressed into a buffer,
+ * either in-process or through a pipe from the decompression utility,
+ * depending on the libraries available when MBPlib was configured.
+ *
+ * Columnar traces (extension .sbbtc, see MakeColumnarTrace)
+ * are memory-mapped and their arrays are copied without decoding.
+ *
+ * If the trace has an index (see SbbtIndex),
+ * it is loaded on construction and used by seek().
  */
 class SbbtReader {
  public:
-  static constexpr unsigned SBBT_VERSION_MAJOR = 1;
+  // Latest version of the SBBT format supported.
+  static constexpr unsigned SBBT_VERSION_MAJOR = 2;
   static constexpr unsigned SBBT_VERSION_MINOR = 0;
   static constexpr unsigned SBBT_VERSION_PATCH = 0;
 
   SbbtReader(const SbbtReader& other) = delete;
   SbbtReader(SbbtReader&& other);
   SbbtReader(const std::string& trace);
+  SbbtReader(const std::string& trace, const SbbtReaderOptions& options);
   ~SbbtReader();
 
   /**
@@ -47,6 +98,59 @@ class SbbtReader {
    */
   int64_t nextBranch(Branch& b);
 
+  /**
+   * Reads up to n subsequent branches and their instruction numbers.
+   *
+   * Decoding branches in batches is faster than calling nextBranch()
+   * once per branch.
+   *
+   * @param branches Array of at least n elements to store the branches.
+   * @param instrNums Array of at least n elements
+   *                  to store the branch instruction numbers.
+   * @return the number of branches read,
+   *         which is lower than n only if there are no more branches.
+   */
+  size_t nextBranches(Branch* branches, int64_t* instrNums, size_t n);
+
+  /**
+   * Reads up to n subsequent branches into a structure of arrays.
+   *
+   * This is the fastest way of reading a trace.
+   * Decoding uses the widest vector instructions supported by the processor.
+   *
+   * @param branches Arrays of at least n elements to store the branches.
+   * @return the number of branches read,
+   *         which is lower than n only if there are no more branches.
+   */
+  size_t nextBranches(const BranchArrays& branches, size_t n);
+
+  /**
+   * Moves the reader to the first branch
+   * with an instruction number greater or equal to instrNum.
+   *
+   * Afterwards, lastInstrRead() returns the instruction number
+   * of the branch before it (or 0 if there is none).
+   * If the trace is seekable, the reader jumps to the chunk of the branch,
+   * in any direction, and skips the branches before it in that chunk.
+   * Otherwise, the reader can only skip forward
+   * and an exception is thrown if instrNum was already passed.
+   */
+  void seek(int64_t instrNum);
+
+  /**
+   * Tells whether the reader can jump to any position of the trace.
+   *
+   * Columnar traces always can. Other traces require an index
+   * and either an uncompressed trace
+   * or a .sbbt.zst trace decompressed with libzstd.
+   */
+  bool seekable() const;
+
+  /**
+   * Returns the major version of the SBBT format of the trace.
+   */
+  constexpr unsigned version() const { return header_.sbbtMark >> 40 & 0xFF; }
+
   /**
    * Returns the number of instructions specified in the trace header.
    */
@@ -62,6 +166,30 @@ class SbbtReader {
    */
   constexpr int64_t lastInstrRead() const { return instrCtr_; }
 
+  /**
+   * Returns the number of static branch identifiers,
+   * which are dense numbers from 0 assigned to the branch addresses.
+   *
+   * For v2 and columnar traces, they are stored in the trace
+   * and loaded when it is opened, so the number is known before reading.
+   * v1 traces do not store them, so their branches are read
+   * with Branch::NO_STATIC_ID and the number is 0.
+   * Numbering them while reading would cost a hash table lookup per branch;
+   * sbbt_cache numbers them once instead (see MakeColumnarTrace).
+   */
+  size_t numStaticIds() const { return staticIps_.size(); }
+
+  /**
+   * Tells whether the static branch identifiers are stored in the trace
+   * (see numStaticIds()).
+   */
+  bool storesStaticIds() const { return columnar_ || dictionary_ != nullptr; }
+
+  /**
+   * Returns the address of each static branch identifier.
+   */
+  const std::vector<uint64_t>& staticIps() const { return staticIps_; }
+
  private:
   struct SbbtHeader {
     uint64_t sbbtMark;
@@ -72,19 +200,60 @@ class SbbtReader {
   static constexpr uint64_t SBBT_MARK_WO_VERSION_MASK = 0x000000FFFFFFFFFFULL;
   static constexpr uint64_t SBBT_MARK_WO_VERSION = 0x0000000A54424253ULL;
   static constexpr uint64_t SBBT_MARK_WITH_VERSION = 0x0000010A54424253ULL;
+  static constexpr uint64_t SBBT_V2_MARK_WITH_VERSION = 0x0000020A54424253ULL;
   // Read size equals the Linux pipe buffer size, which is 4 pages.
   static constexpr size_t READ_SIZE = 1 << 16;
+  // Size of the largest branch record, that of v1.
   static constexpr size_t SIZEOF_SBBT_BRANCH = 16;
 
+  /**
+   * Columns of a columnar trace, which point into the mapping.
+   */
+  struct Columns {
+    const uint64_t* ip;
+    const uint64_t* target;
+    // Opcode and outcome.
+    const uint8_t* flags;
+    const uint16_t* ninstr;
+    const uint32_t* staticId;
+    // Instruction numbers of every checkpointBranches branches.
+    const int64_t* checkpoints;
+    uint64_t checkpointBranches;
+  };
+
+  bool mapFile(const std::string& trace);
+  void mapColumns(const std::string& trace);
+  size_t nextColumnarBranches(const BranchArrays& branches, size_t n);
+  void seekColumnar(int64_t instrNum);
+  bool fillBuffer(size_t minBytes);
+  void readDictionary(const std::string& trace);
+
   // The size of buffer_ is chosen so that
   // if we do not have enough bytes to return a branch to the user,
   // a reading of size READ_SIZE is always possible.
   std::array<char, READ_SIZE + SIZEOF_SBBT_BRANCH> buffer_;
-  FILE* trace_;
-  size_t bufferStart_;
-  size_t bufferEnd_;
+  std::unique_ptr<TraceSource> source_;
+  // Memory mapping of the trace, or nullptr if the trace is read into buffer_.
+  char* mapping_;
+  size_t mappingSize_;
+  // Unread bytes, either in buffer_ or in the mapping.
+  const char* bufferStart_;
+  const char* bufferEnd_;
   int64_t instrCtr_;
   SbbtHeader header_;
+  // Size of the branch records, which depends on the version.
+  size_t recordSize_;
+  // Dictionary of a v2 trace, or nullptr for other versions.
+  std::unique_ptr<SbbtDictionary> dictionary_;
+  // Index of the trace, empty if it does not have one.
+  SbbtIndex index_;
+  // Whether the trace is columnar, in which case it is read from columns_.
+  bool columnar_;
+  Columns columns_;
+  // Number of branches of a columnar trace that have been read.
+  uint64_t branchCtr_;
+  // Address of each static branch identifier.
+  std::vector<uint64_t> staticIps_;
 };
 
 }  // namespace mbp
@@ -4,6 +4,8 @@
 #include <array>
 #include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #ifdef __GNUC__
 static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
@@ -20,10 +22,19 @@ namespace mbp {
 
 /**
  * Trace writer for the SBBT format.
+ *
+ * Traces are written in v1 by default.
+ * v2 traces store each distinct combination of ip, target and opcode once,
+ * in a dictionary after the header, and 8-byte branch records
+ * that refer to it, instead of 16-byte records.
+ * They are smaller and faster to decompress,
+ * but the dictionary is only known after adding all the branches,
+ * so the branches are compressed twice, the first time with a fast level.
  */
 class SbbtWriter {
  public:
-  static constexpr unsigned SBBT_VERSION_MAJOR = 1;
+  // Latest version of the SBBT format supported.
+  static constexpr unsigned SBBT_VERSION_MAJOR = 2;
   static constexpr unsigned SBBT_VERSION_MINOR = 0;
   static constexpr unsigned SBBT_VERSION_PATCH = 0;
   static constexpr uint8_t CND = 0b0001U;
@@ -32,6 +43,8 @@ class SbbtWriter {
   static constexpr uint8_t JUMP = 0b0000U;
   static constexpr uint8_t CALL = 0b1000U;
   static constexpr uint8_t RET = 0b0100U;
+  // Maximum zstd compression level, used by default.
+  static constexpr int MAX_COMPRESSION_LEVEL = 22;
 
   /**
    * Constructs an object SbbtWriter that will write to the file indicated.
@@ -42,9 +55,15 @@ class SbbtWriter {
    * or, if close() is not called, the file will be erased by the destructor.
    * If you use this constructor and call close with the number of instructions,
    * the number should be the same.
+   *
+   * The trace is compressed with the given zstd level (1 to 22).
+   * Lower levels are much faster, at the cost of larger traces.
+   * The version of the SBBT format must be 1 or 2.
    */
   SbbtWriter(const std::string& filename, uint64_t numInstructions,
-             uint64_t numBranches);
+             uint64_t numBranches,
+             int compressionLevel = MAX_COMPRESSION_LEVEL,
+             unsigned version = 1);
 
   /**
    * Constructs an object SbbtWriter that will write to the file indicated.
@@ -132,6 +151,27 @@ class SbbtWriter {
     uint64_t numBranches;
   };
   static_assert(sizeof(SbbtHeader) == 24);
+  // Version mark of SBBT v2.0.0.
+  static constexpr uint64_t SBBT_V2_MARK = 0x0000020A54424253ULL;
+
+  /**
+   * Key of an entry of the dictionary of a v2 trace.
+   */
+  struct DictionaryKey {
+    uint64_t ip;
+    uint64_t target;
+    uint8_t opcode;
+    bool operator==(const DictionaryKey& o) const {
+      return ip == o.ip && target == o.target && opcode == o.opcode;
+    }
+  };
+  struct DictionaryKeyHash {
+    size_t operator()(const DictionaryKey& k) const {
+      uint64_t h = (k.ip * 0x9E3779B97F4A7C15ULL) ^ k.target ^ k.opcode;
+      h *= 0x9E3779B97F4A7C15ULL;
+      return h ^ (h >> 32);
+    }
+  };
   // Write size equals the Linux pipe buffer size, which is 4 pages.
   static constexpr int BUFFER_SIZE = 1 << 10;
 
@@ -142,6 +182,13 @@ class SbbtWriter {
   uint64_t numInstructionsHeader_ = 0;
   uint64_t numBranchesHeader_ = 0;
   std::string filename_;
+  int compressionLevel_ = MAX_COMPRESSION_LEVEL;
+  unsigned version_ = 1;
+  // Entries of the dictionary of a v2 trace, encoded as v1 records,
+  // and their indices.
+  std::vector<uint64_t> dictionary_;
+  std::unordered_map<DictionaryKey, uint32_t, DictionaryKeyHash>
+      dictionaryIndices_;
   size_t bufferSize_ = 0;
   bool headerWritten_ = false;
 };
@@ -1,7 +1,13 @@
 #ifndef MBP_SIMULATOR_HPP_
 #define MBP_SIMULATOR_HPP_
 
+#include <array>
+#include <functional>
+#include <iosfwd>
+#include <memory>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "mbp/core/predictor.hpp"
@@ -12,42 +18,338 @@ namespace mbp {
 constexpr int ERR_INPUT_DATA = 1;
 // Exit code of the simulator when there was an error during simulation.
 constexpr int ERR_SIMULATION_ERROR = 2;
+// Default warmup of each segment in a segmented simulation.
+constexpr int64_t DEFAULT_WARMUP_OVERLAP = 10'000'000;
+// Maximum segments of a segmented simulation per hardware thread.
+constexpr int MAX_SEGMENTS_PER_THREAD = 4;
+// Default period of the profile of Simulate.
+constexpr int64_t DEFAULT_PROFILE_PERIOD = 64;
+
+/**
+ * Formats in which the mains print the outputs of the simulations.
+ */
+enum class OutputFormat {
+  // A single JSON document, indented with 2 spaces.
+  JSON,
+  // A sequence of records (see WriteReport), one JSON document per line.
+  NDJSON,
+  // A sequence of records, each one a CBOR data item (RFC 8742).
+  CBOR,
+  // A sequence of records, each one a MessagePack object.
+  MSGPACK,
+};
 
 struct SimArgs {
   std::string tracepath;
   int64_t warmupInstrs;
   int64_t simInstr;
   int64_t stopAtInstr;
+  // Decompress the trace in a background thread (see SbbtReaderOptions).
+  bool prefetch = false;
+  // Number of threads of ParallelSim and SuiteSim.
+  int threads = 1;
+  // Directory where Simulate stores the state of the predictor
+  // after the warmup, to load it instead of repeating the warmup
+  // in later simulations. Empty to disable the snapshots.
+  std::string snapshotDir;
+  // Length in instructions of the intervals after the warmup
+  // whose statistics Simulate reports. 0 to report only the totals.
+  int64_t intervalInstrs = 0;
+  // Directory where Simulate stores its outputs, to return them
+  // instead of repeating identical simulations. Empty to disable the cache.
+  std::string cacheDir;
+  // Version of the predictor, which is part of the key of the cached outputs.
+  // It must change when the code of the predictor changes
+  // without changing its metadata_stats().
+  std::string cacheTag;
+  // One of every profilePeriod branches of Simulate is profiled
+  // (see "profile" in its output). 0 to disable the profile.
+  int64_t profilePeriod = 0;
+  // Report the hardware performance counters of the host
+  // during Simulate and ParallelSim.
+  bool hostCounters = false;
+  // Format of the output printed by the mains.
+  OutputFormat outputFormat = OutputFormat::JSON;
+  // If not empty, Simulate passes it the statistics of each interval
+  // as soon as the interval ends, and leaves them out of its output.
+  std::function<void(const json&)> intervalSink;
 };
 
 SimArgs ParseCmdLineArgs(int argc, char** argv);
 
 /**
  * Simulates a trace.
+ *
+ * If args.intervalInstrs is not 0, the output also contains
+ * the statistics of each interval of that many instructions
+ * after the warmup, in the array "intervals".
+ * If args.intervalSink is not empty, the intervals are passed to it
+ * as they end instead, and they are not kept until the end
+ * unless args.cacheDir is not empty.
+ *
+ * If args.snapshotDir is not empty and there is a warmup,
+ * the predictor is restored from the snapshot in that directory
+ * with the same trace, warmup and predictor metadata_stats(),
+ * and the trace is simulated from the end of the warmup.
+ * If there is no such snapshot, the predictor is saved
+ * at the end of the warmup. The predictor must implement
+ * Predictor::serialize and Predictor::deserialize.
+ *
+ * If args.cacheDir is not empty, the output is stored in that directory,
+ * and it is returned without simulating if it was already there.
+ * The outputs are identified by the header and the contents of the trace,
+ * the warmup, simulation and interval instructions,
+ * the predictor metadata_stats() and args.cacheTag.
+ * On a hit, the predictor is not modified,
+ * and the simulation time is that of the cached simulation.
+ *
+ * If args.profilePeriod is not 0, the output also contains
+ * the estimated time spent decoding the trace, in each method
+ * of the predictor and updating the statistics, in the object "profile".
+ * Only one of every args.profilePeriod branches is timed.
+ *
+ * If args.hostCounters is true, the output also contains the cycles,
+ * instructions, last level cache misses, data TLB misses
+ * and branch misses of the host during the simulation,
+ * in the object "host_counters".
  */
 json Simulate(Predictor* branchPredictor, const SimArgs& args);
 
+/**
+ * Simulates a trace, calling the methods of P directly.
+ *
+ * Unlike the version that takes a Predictor*, the methods of the predictor
+ * are called through its static type P. If P is final, as the examples are,
+ * they are not called through the vtable, so they can be inlined
+ * in the simulation loop. Otherwise, the calls are still virtual.
+ */
+template <class P,
+          class = std::enable_if_t<std::is_base_of_v<Predictor, P>>>
+json Simulate(P& branchPredictor, const SimArgs& args);
+
+/**
+ * Function that creates a new predictor with its initial state.
+ */
+using PredictorFactory = std::function<std::unique_ptr<Predictor>()>;
+
+/**
+ * Simulates a trace split in segments that are simulated concurrently.
+ *
+ * The simulated instructions are divided in numSegments segments
+ * of the same length, each simulated by a new predictor in its own thread.
+ * Except for the first one, which is warmed up like in Simulate,
+ * each segment is warmed up with the warmupOverlap instructions before it.
+ * The statistics of the segments are merged,
+ * so the result approximates that of Simulate
+ * with an error that decreases as warmupOverlap increases.
+ *
+ * Segments jump to their start quickly if the trace is seekable
+ * (see SbbtIndex). Otherwise, each one skips the instructions before it.
+ * Each segment costs a predictor, a thread and a trace reader,
+ * and its warmup, so numSegments should be close to the hardware threads.
+ */
+json SegmentedSimulate(const PredictorFactory& makePredictor,
+                       const SimArgs& args, int numSegments,
+                       int64_t warmupOverlap = DEFAULT_WARMUP_OVERLAP);
+
 /**
  * Simulates multiple predictors in parallel.
+ *
+ * If args.threads is greater than 1, the predictors are divided
+ * among that many threads. The trace is decoded only once,
+ * by the calling thread, into chunks that all the threads read.
+ * The result is the same regardless of the number of threads.
+ * Like in Simulate, args.hostCounters adds the counters of the host,
+ * including those of all the threads.
  */
 json ParallelSim(const std::vector<Predictor*>& predictor, const SimArgs& args);
 
+/**
+ * Simulates multiple predictors of known types in parallel,
+ * calling their methods directly like the templated Simulate.
+ */
+template <class... P, class = std::enable_if_t<
+                          (std::is_base_of_v<Predictor, P> && ...)>>
+json ParallelSim(std::tuple<P...>& predictors, const SimArgs& args);
+
+/**
+ * Simulates every predictor on every trace of a suite.
+ *
+ * The predictors are divided in groups of groupSize predictors
+ * (all of them if groupSize is 0) and each pair of trace and group
+ * is simulated with ParallelSim, so each trace is decoded once per group.
+ * The pairs are scheduled on a pool of args.threads threads
+ * with work stealing. The tracepath of args is ignored.
+ *
+ * The result contains, for each trace, the results of ParallelSim
+ * for all the predictors, in order. A pair that fails (e.g. because
+ * its trace does not exist) is reported in the errors of its trace.
+ */
+json SuiteSim(const std::vector<std::string>& traces,
+              const std::vector<PredictorFactory>& makePredictors,
+              const SimArgs& args, size_t groupSize = 0);
+
+/**
+ * Options of SuccessiveHalving.
+ */
+struct HalvingOptions {
+  // Instructions after the warmup simulated by all the candidates.
+  int64_t firstRungInstrs = 10'000'000;
+  // Factor by which the simulated instructions grow in each rung.
+  // It must be greater than 1.
+  double rungGrowth = 2;
+  // Fraction of the candidates that survive each rung, in (0, 1].
+  double keepFraction = 0.5;
+  // Candidates that are never eliminated, which simulate the whole trace.
+  size_t minSurvivors = 1;
+};
+
+/**
+ * Searches the best of several candidate predictors by successive halving.
+ *
+ * All the candidates are simulated on a prefix of the trace
+ * (the rung) of options.firstRungInstrs instructions after the warmup.
+ * Then, only the options.keepFraction with the lowest MPKI survive,
+ * and the survivors continue with a rung options.rungGrowth times longer,
+ * until options.minSurvivors remain, which simulate the rest of the trace.
+ * The trace is decoded only once, and each chunk of branches
+ * is simulated by all the surviving candidates.
+ *
+ * The result contains the metrics of each candidate
+ * over the instructions that it simulated, the rungs and
+ * the candidates ranked from best to worst.
+ * An eliminated candidate is always ranked below those that outlived it.
+ */
+json SuccessiveHalving(const std::vector<PredictorFactory>& makeCandidates,
+                       const SimArgs& args,
+                       const HalvingOptions& options = {});
+
 /**
  * Simulates a trace with two predictors and compares them.
  */
 json Compare(std::array<Predictor*, 2> predictor, const SimArgs& args);
 
+/**
+ * Simulates a trace with two predictors of known types and compares them,
+ * calling their methods directly like the templated Simulate.
+ */
+template <class P0, class P1,
+          class = std::enable_if_t<std::is_base_of_v<Predictor, P0> &&
+                                   std::is_base_of_v<Predictor, P1>>>
+json Compare(P0& predictor0, P1& predictor1, const SimArgs& args);
+
+/**
+ * Simulates a trace with any number of predictors and compares them.
+ *
+ * The trace is decoded once, and the mispredictions of every predictor
+ * are counted per branch in a single table.
+ * The result contains the MPKI of each predictor, the matrices
+ * of differences between each pair of predictors, both of their MPKI
+ * and of the mispredictions of each branch, and the branches
+ * that separate the predictors the most, i.e., those with the largest
+ * range of mispredictions among the predictors.
+ *
+ * With a single predictor, the matrices of differences are 1x1 and zero,
+ * every range of mispredictions is 0 and no branch is listed as separating.
+ * Without predictors, it throws std::invalid_argument.
+ */
+json MultiCompare(const std::vector<Predictor*>& predictors,
+                  const SimArgs& args);
+
+/**
+ * Writes the output of a simulation in the given format.
+ *
+ * In the formats other than JSON, the output is split in a sequence
+ * of records, which are JSON objects whose "record" is the kind of record.
+ * Each element of an array of objects of the output,
+ * e.g. the intervals of Simulate, the results of ParallelSim
+ * or the traces of SuiteSim, is written as a record
+ * with the name of the array as kind and the fields of the element.
+ * The rest of the output follows in a last record of kind "summary".
+ * The output must be complete, so only the intervals of Simulate
+ * can be written earlier, through args.intervalSink.
+ */
+void WriteReport(std::ostream& os, const json& output, OutputFormat format);
+
+/**
+ * Writes a record of the given kind with the fields of an object.
+ *
+ * In JSON format, the record is written in a single line, like in NDJSON.
+ * The fields cannot have the key "record", which holds the kind,
+ * or std::invalid_argument is thrown.
+ */
+void WriteRecord(std::ostream& os, const std::string& kind,
+                 const json& fields, OutputFormat format);
+
 /**
  * Parses the command line arguments, calls mbp::Simulate and prints the output.
  */
 int SimMain(int argc, char** argv, Predictor* branchPredictor);
 
+/**
+ * Parses the command line arguments, calls the templated mbp::Simulate
+ * and prints the output.
+ */
+template <class P,
+          class = std::enable_if_t<std::is_base_of_v<Predictor, P>>>
+int SimMain(int argc, char** argv, P& branchPredictor);
+
+/**
+ * Parses the command line arguments, calls mbp::SegmentedSimulate
+ * and prints the output.
+ *
+ * Besides the arguments of SimMain, it accepts the options
+ * --segments=<num> (by default, the number of hardware threads)
+ * and --warmup-overlap=<instr>.
+ */
+int SegmentedSimMain(int argc, char** argv,
+                     const PredictorFactory& makePredictor);
+
+/**
+ * Parses the command line arguments, calls mbp::SuiteSim
+ * and prints the output.
+ *
+ * The command line is `<program> [<options>] <trace>...`.
+ * Run the program without arguments to see the options.
+ */
+int SuiteMain(int argc, char** argv,
+              const std::vector<PredictorFactory>& makePredictors);
+
+/**
+ * Parses the command line arguments, calls mbp::SuccessiveHalving
+ * and prints the output.
+ *
+ * Besides the arguments of SimMain, it accepts the options
+ * --first-rung=<instr>, --rung-growth=<factor>, --keep-fraction=<fraction>
+ * and --min-survivors=<num> (see HalvingOptions).
+ */
+int SuccessiveHalvingMain(int argc, char** argv,
+                          const std::vector<PredictorFactory>& makeCandidates);
+
 /**
  * Parses the command line arguments, calls mbp::Compare and prints the output.
  */
 int CompareMain(int argc, char** argv,
                 std::array<Predictor*, 2> comparedPredictors);
 
+/**
+ * Parses the command line arguments, calls mbp::MultiCompare
+ * and prints the output.
+ */
+int MultiCompareMain(int argc, char** argv,
+                     const std::vector<Predictor*>& predictors);
+
+/**
+ * Parses the command line arguments, calls the templated mbp::Compare
+ * and prints the output.
+ */
+template <class P0, class P1,
+          class = std::enable_if_t<std::is_base_of_v<Predictor, P0> &&
+                                   std::is_base_of_v<Predictor, P1>>>
+int CompareMain(int argc, char** argv, P0& predictor0, P1& predictor1);
+
 }  // namespace mbp
 
+#include "mbp/sim/simulator_impl.hpp"
+
 #endif  // MBP_SIMULATOR_HPP_
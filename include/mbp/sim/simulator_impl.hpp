@@ -0,0 +1,790 @@
+#ifndef MBP_SIMULATOR_IMPL_HPP_
+#define MBP_SIMULATOR_IMPL_HPP_
+
+// Definitions of the simulator templates, included by simulator.hpp.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mbp/sim/ip_table.hpp"
+#include "mbp/sim/sbbt_reader.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+namespace detail {
+
+// Number of branches decoded at once by the simulators.
+constexpr size_t BATCH_SIZE = 1024;
+// Maximum number of branches listed in the outputs of the simulators.
+constexpr size_t MAX_NUM_LISTED_BRANCHES = 20;
+
+/**
+ * Sampled profile of the time spent in each phase of a simulation.
+ *
+ * The decoding of every batch of branches is timed, whereas
+ * the other phases are only timed for one of every period branches
+ * and extrapolated to the rest, to keep the overhead low.
+ * The time is measured with the time stamp counter on x86
+ * and with std::chrono::steady_clock elsewhere.
+ */
+class PhaseProfiler {
+ public:
+  enum Phase { DECODE, PREDICT, TRAIN, TRACK, STATS, NUM_PHASES };
+
+  explicit PhaseProfiler(int64_t period);
+
+  /**
+   * Returns the current time in ticks of the timer.
+   */
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  /**
+   * Counts a branch and tells whether its phases must be timed.
+   */
+  bool sample() {
+    ++numBranches_;
+    if (--countdown_ != 0) return false;
+    countdown_ = period_;
+    ++numSampled_;
+    return true;
+  }
+
+  void add(Phase phase, uint64_t ticks) { ticks_[phase] += ticks; }
+
+  /**
+   * Returns the profile of the simulation, which must have just finished.
+   */
+  json report() const;
+
+ private:
+  int64_t period_;
+  int64_t countdown_;
+  int64_t numBranches_ = 0;
+  int64_t numSampled_ = 0;
+  std::array<uint64_t, NUM_PHASES> ticks_ = {};
+  // Ticks that reading the timer adds to each measurement.
+  uint64_t overheadTicks_;
+  // To convert ticks to seconds.
+  uint64_t startTicks_;
+  std::chrono::steady_clock::time_point startTime_;
+};
+
+/**
+ * Hardware performance counters of the host during a simulation,
+ * counted with perf_event_open for the calling thread
+ * and the threads that it creates after construction.
+ *
+ * The counters that cannot be opened (e.g. because perf_event_paranoid
+ * does not allow it or the host does not support them) are reported
+ * as null, with the reason in the errors of the report.
+ */
+class HostCounters {
+ public:
+  explicit HostCounters(bool enabled);
+  HostCounters(const HostCounters&) = delete;
+  HostCounters& operator=(const HostCounters&) = delete;
+  ~HostCounters();
+
+  /**
+   * Resets and starts the counters.
+   */
+  void start();
+
+  /**
+   * Stops the counters and reads them.
+   */
+  void stop();
+
+  /**
+   * Returns the counters, the IPC and the counters per 1000 instructions
+   * of the trace, given the instructions of the trace simulated.
+   */
+  json report(int64_t simulatedInstr) const;
+
+ private:
+  struct Counter {
+    const char* name;
+    int fd;
+    uint64_t value;
+  };
+
+  bool enabled_;
+  std::vector<Counter> counters_;
+  std::vector<std::string> errors_;
+};
+
+/**
+ * Decodes the next batch of branches of the trace,
+ * timing it if profiler is not null.
+ *
+ * @return the number of branches decoded.
+ */
+inline size_t NextBatch(SbbtReader& trace, const BranchArrays& batch,
+                        PhaseProfiler* profiler) {
+  if (profiler == nullptr) return trace.nextBranches(batch, BATCH_SIZE);
+  uint64_t start = PhaseProfiler::now();
+  size_t n = trace.nextBranches(batch, BATCH_SIZE);
+  profiler->add(PhaseProfiler::DECODE, PhaseProfiler::now() - start);
+  return n;
+}
+
+/**
+ * Calls f(branch, instrNum) for each branch of the trace
+ * whose instruction number is lower than stopAtInstr.
+ *
+ * The branches are decoded in batches, as a structure of arrays.
+ * If profiler is not null, the decoding of each batch is timed.
+ *
+ * @return whether the trace was exhausted before reaching stopAtInstr.
+ */
+template <typename F>
+bool ForEachBranch(SbbtReader& trace, int64_t stopAtInstr, F&& f,
+                   PhaseProfiler* profiler = nullptr) {
+  std::array<uint64_t, BATCH_SIZE> ip, target;
+  std::array<uint8_t, BATCH_SIZE> opcode, outcome;
+  std::array<int64_t, BATCH_SIZE> instrNum;
+  std::array<uint32_t, BATCH_SIZE> staticId;
+  BranchArrays batch = {ip.data(),      target.data(),   opcode.data(),
+                        outcome.data(), instrNum.data(), staticId.data()};
+  size_t n;
+  while ((n = NextBatch(trace, batch, profiler)) != 0) {
+    for (size_t i = 0; i < n; ++i) {
+      if (instrNum[i] >= stopAtInstr) return false;
+      f(Branch{ip[i], target[i], static_cast<Branch::OpCode>(opcode[i]),
+               outcome[i], staticId[i]},
+        instrNum[i]);
+    }
+  }
+  return true;
+}
+
+/**
+ * Simulates a branch with the predictor.
+ *
+ * The methods are called through the static type P.
+ * If P is final, the compiler resolves them without dynamic dispatch,
+ * so that they can be inlined.
+ *
+ * @return whether the branch is conditional and was mispredicted.
+ */
+template <class P>
+bool SimulateBranch(P& predictor, const Branch& b) {
+  if (!b.isConditional()) {
+    predictor.track(b);
+    return false;
+  }
+  bool predictedTaken = predictor.predict(b.ip());
+  predictor.train(b);
+  predictor.track(b);
+  return predictedTaken != b.isTaken();
+}
+
+struct BranchInfo {
+  int64_t occurrences, misses;
+};
+
+/**
+ * Statistics of an interval of instructions of a simulation.
+ */
+struct IntervalStats {
+  int64_t startInstr;
+  int64_t numBranches;
+  int64_t mispredictions;
+  // Time spent simulating the interval.
+  double seconds;
+};
+
+/**
+ * Values associated to the static branches of a trace.
+ *
+ * They are indexed by Branch::staticId() if the trace stores
+ * the identifiers, and looked up by ip in a hash table otherwise.
+ * The values are value-initialized the first time they are accessed.
+ */
+template <class T>
+class BranchTable {
+ public:
+  BranchTable() = default;
+
+  /**
+   * Creates a table sized for the static branches of a trace.
+   */
+  explicit BranchTable(const SbbtReader& trace)
+      : byId_(trace.numStaticIds()),
+        // The header of traces without identifiers only has the number
+        // of dynamic branches, which bounds the number of static branches,
+        // but is usually much larger.
+        byIp_(trace.storesStaticIds()
+                  ? 0
+                  : std::min<uint64_t>(trace.numBranches(), 1 << 15)) {}
+
+  T& operator[](const Branch& b) {
+    uint32_t id = b.staticId();
+    if (id == Branch::NO_STATIC_ID) return byIp_[b.ip()];
+    if (id >= byId_.size()) byId_.resize(id + 1);
+    return byId_[id];
+  }
+
+  /**
+   * Calls f(ip, value) for each value of the table,
+   * given the address of each static branch identifier.
+   * The values of the identifiers that were not accessed are included.
+   */
+  template <class F>
+  void forEach(const std::vector<uint64_t>& staticIps, F&& f) const {
+    for (size_t id = 0; id < byId_.size(); ++id) f(staticIps[id], byId_[id]);
+    for (const auto& entry : byIp_) f(entry.ip, entry.value);
+  }
+
+ private:
+  std::vector<T> byId_;
+  IpTable<T> byIp_;
+};
+
+/**
+ * Statistics collected by Simulate.
+ */
+struct SimStats {
+  BranchTable<BranchInfo> branchInfo;
+  int64_t numBranches = 0;
+  int64_t mispredictions = 0;
+  // Only if SimArgs::intervalInstrs is not 0, and, if the intervals
+  // are passed to SimArgs::intervalSink, only to cache them.
+  std::vector<IntervalStats> intervals;
+};
+
+/**
+ * Adds a conditional branch after the warmup to the statistics.
+ */
+inline void RecordBranch(SimStats& stats, const Branch& b, bool mispredicted) {
+  BranchInfo& info = stats.branchInfo[b];
+  stats.numBranches += 1;
+  stats.mispredictions += mispredicted;
+  info.occurrences += 1;
+  info.misses += mispredicted;
+}
+
+/**
+ * Splits the statistics of a simulation in intervals
+ * of SimArgs::intervalInstrs instructions after the warmup.
+ *
+ * It must be called with the instruction number of every branch
+ * before it is simulated, and finish() must be called at the end.
+ */
+class IntervalRecorder {
+ public:
+  /**
+   * Creates the recorder of a simulation that ends at endInstr.
+   */
+  IntervalRecorder(const SimArgs& args, int64_t endInstr, SimStats& stats);
+
+  void operator()(int64_t instrNum) {
+    if (instrNum >= nextBoundary_) advance(instrNum);
+  }
+
+  /**
+   * Records the last interval, which can be shorter than the others.
+   */
+  void finish();
+
+ private:
+  /**
+   * Records the intervals that end before instrNum.
+   */
+  void advance(int64_t instrNum);
+
+  /**
+   * Records the current interval and starts the next one.
+   */
+  void record(std::chrono::steady_clock::time_point now);
+
+  SimStats& stats_;
+  const std::function<void(const json&)>& sink_;
+  // Whether the intervals are kept in SimStats::intervals.
+  bool keep_;
+  int64_t endInstr_;
+  int64_t length_;
+  int64_t nextBoundary_;
+  bool started_;
+  // Start of the current interval.
+  int64_t startInstr_;
+  int64_t startBranches_;
+  int64_t startMispredictions_;
+  std::chrono::steady_clock::time_point startTime_;
+};
+
+/**
+ * Number of times that each branch was predicted correctly (bit i is 0)
+ * or mispredicted (bit i is 1) by predictor i of Compare.
+ */
+using CompareInfo = std::array<int64_t, 4>;
+
+/**
+ * Data of a simulation that does not depend on the predictors.
+ */
+struct TraceRun {
+  int64_t numInstructions;
+  int64_t lastInstrRead;
+  bool exhaustedTrace;
+  double simulationTime;
+  // Address of each static branch identifier.
+  std::vector<uint64_t> staticIps;
+};
+
+/**
+ * Returns the data of a simulation of trace started at startTime.
+ */
+TraceRun EndTraceRun(const SbbtReader& trace, bool exhaustedTrace,
+                     std::chrono::high_resolution_clock::time_point startTime);
+
+/**
+ * Returns the number of instructions used to compute the metrics
+ * and adds an error to errors if the trace was too short.
+ */
+int64_t MetricInstr(const SimArgs& args, const TraceRun& run,
+                    std::vector<std::string>& errors);
+
+/**
+ * Snapshot of a predictor at the end of the warmup of a simulation.
+ *
+ * It is stored in args.snapshotDir, in a file named after the hash of
+ * the trace, the warmup instructions and the metadata of the predictor.
+ */
+class WarmupSnapshot {
+ public:
+  WarmupSnapshot(const SimArgs& args, const SbbtReader& trace,
+                 const json& metadata);
+
+  /**
+   * Tells whether the simulation asks for snapshots.
+   */
+  bool enabled() const { return !path_.empty(); }
+
+  /**
+   * Restores the predictor from the snapshot.
+   *
+   * @return false if there is no snapshot.
+   */
+  bool load(Predictor& predictor) const;
+
+  /**
+   * Stores the state of the predictor.
+   */
+  void save(const Predictor& predictor) const;
+
+ private:
+  std::string key_;
+  std::string path_;
+};
+
+/**
+ * Cache of the outputs of Simulate.
+ *
+ * They are stored in args.cacheDir, in files named after the hash of
+ * the header and the contents of the trace, the arguments of the simulation
+ * that change its output, the metadata of the predictor and args.cacheTag.
+ */
+class ResultCache {
+ public:
+  ResultCache(const SimArgs& args, const SbbtReader& trace,
+              const json& metadata);
+
+  /**
+   * Tells whether the simulation asks for the cache.
+   */
+  bool enabled() const { return !path_.empty(); }
+
+  /**
+   * Returns the cached output, or null if there is none.
+   */
+  json load() const;
+
+  /**
+   * Stores the output of the simulation.
+   */
+  void save(const json& output) const;
+
+ private:
+  std::string tracepath_;
+  std::string key_;
+  std::string path_;
+};
+
+/**
+ * Simulates the branches of the trace before stopAtInstr,
+ * collecting statistics for those from warmupInstrs onwards.
+ *
+ * beforeBranch(instrNum) is called before simulating each branch.
+ *
+ * @return whether the trace was exhausted before reaching stopAtInstr.
+ */
+template <class P, class F>
+bool SimulateBranches(P& predictor, SbbtReader& trace, int64_t warmupInstrs,
+                      int64_t stopAtInstr, SimStats& stats, F&& beforeBranch) {
+  return ForEachBranch(
+      trace, stopAtInstr, [&](const Branch& b, int64_t instrNum) {
+        beforeBranch(instrNum);
+        bool mispredicted = SimulateBranch(predictor, b);
+        if (b.isConditional() && instrNum >= warmupInstrs) {
+          RecordBranch(stats, b, mispredicted);
+        }
+      });
+}
+
+/**
+ * Simulates a branch with the predictor like SimulateBranch
+ * and calls record(mispredicted), profiling each phase
+ * if the profiler samples the branch.
+ */
+template <class P, class F>
+void ProfileBranch(P& predictor, const Branch& b, PhaseProfiler& profiler,
+                   F&& record) {
+  if (!profiler.sample()) {
+    record(SimulateBranch(predictor, b));
+    return;
+  }
+  // The phases of SimulateBranch, one at a time.
+  bool predictedTaken = b.isTaken();
+  uint64_t t0 = PhaseProfiler::now();
+  if (b.isConditional()) predictedTaken = predictor.predict(b.ip());
+  uint64_t t1 = PhaseProfiler::now();
+  if (b.isConditional()) predictor.train(b);
+  uint64_t t2 = PhaseProfiler::now();
+  predictor.track(b);
+  uint64_t t3 = PhaseProfiler::now();
+  record(predictedTaken != b.isTaken());
+  uint64_t t4 = PhaseProfiler::now();
+  profiler.add(PhaseProfiler::PREDICT, t1 - t0);
+  profiler.add(PhaseProfiler::TRAIN, t2 - t1);
+  profiler.add(PhaseProfiler::TRACK, t3 - t2);
+  profiler.add(PhaseProfiler::STATS, t4 - t3);
+}
+
+/**
+ * Like SimulateBranches, but profiling the phases of the simulation.
+ */
+template <class P, class F>
+bool ProfileBranches(P& predictor, SbbtReader& trace, int64_t warmupInstrs,
+                     int64_t stopAtInstr, SimStats& stats,
+                     PhaseProfiler& profiler, F&& beforeBranch) {
+  return ForEachBranch(
+      trace, stopAtInstr,
+      [&](const Branch& b, int64_t instrNum) {
+        beforeBranch(instrNum);
+        ProfileBranch(predictor, b, profiler, [&](bool mispredicted) {
+          if (b.isConditional() && instrNum >= warmupInstrs) {
+            RecordBranch(stats, b, mispredicted);
+          }
+        });
+      },
+      &profiler);
+}
+
+template <class P>
+bool SimulateBranches(P& predictor, SbbtReader& trace, int64_t warmupInstrs,
+                      int64_t stopAtInstr, SimStats& stats) {
+  return SimulateBranches(predictor, trace, warmupInstrs, stopAtInstr, stats,
+                          [](int64_t) {});
+}
+
+/**
+ * Simulates the first size branches of a chunk.
+ *
+ * @return the mispredictions from warmupInstrs onwards.
+ */
+template <class P>
+int64_t SimulateChunk(P& predictor, const BranchArrays& chunk, size_t size,
+                      int64_t warmupInstrs) {
+  int64_t misses = 0;
+  for (size_t j = 0; j < size; ++j) {
+    Branch b{chunk.ip[j], chunk.target[j],
+             static_cast<Branch::OpCode>(chunk.opcode[j]), chunk.outcome[j],
+             chunk.staticId[j]};
+    bool mispredicted = SimulateBranch(predictor, b);
+    misses += mispredicted && chunk.instrNum[j] >= warmupInstrs;
+  }
+  return misses;
+}
+
+/**
+ * Decodes the trace in the calling thread and calls
+ * simulateChunk(i, chunk, size) for each predictor i and chunk of branches
+ * before stopAtInstr, dividing the predictors among numThreads threads.
+ *
+ * Each predictor receives all the chunks in order and in the same thread.
+ * numBranches is increased by the conditional branches
+ * from warmupInstrs onwards.
+ *
+ * @return whether the trace was exhausted before reaching stopAtInstr.
+ */
+bool ParallelForEachChunk(
+    SbbtReader& trace, int64_t warmupInstrs, int64_t stopAtInstr,
+    size_t numPredictors, int numThreads, int64_t& numBranches,
+    const std::function<void(size_t, const BranchArrays&, size_t)>&
+        simulateChunk);
+
+/**
+ * Calls f(std::get<i>(t)).
+ */
+template <class Tuple, class F, size_t... I>
+void VisitAt(Tuple& t, size_t i, F&& f, std::index_sequence<I...>) {
+  ((I == i ? f(std::get<I>(t)) : void()), ...);
+}
+
+/**
+ * Builds the output of Simulate.
+ */
+json SimulateReport(const SimArgs& args, const TraceRun& run,
+                    const SimStats& stats, json metadata, json executionStats);
+
+/**
+ * Builds the output of Compare.
+ */
+json CompareReport(const SimArgs& args, const TraceRun& run,
+                   const BranchTable<CompareInfo>& branchInfo,
+                   std::array<json, 2> metadata,
+                   std::array<json, 2> executionStats);
+
+/**
+ * Builds the output of ParallelSim.
+ */
+json ParallelSimReport(const SimArgs& args, const TraceRun& run,
+                       int64_t numBranches,
+                       const std::vector<int64_t>& mispredictions,
+                       std::vector<json> metadata,
+                       std::vector<json> executionStats);
+
+/**
+ * Passes the intervals of a cached output of Simulate
+ * to args.intervalSink, if it is not empty, and removes them from the output.
+ */
+json SendCachedIntervals(const SimArgs& args, json output);
+
+/**
+ * Prints the output of a simulation in args.outputFormat
+ * and returns the exit code.
+ */
+int PrintReport(const json& output, const SimArgs& args);
+
+/**
+ * Makes Simulate print each interval as soon as it ends,
+ * unless args.outputFormat is JSON, which cannot be printed in parts.
+ */
+void PrintIntervalsAsTheyEnd(SimArgs& args);
+
+/**
+ * Sets format to the output format with the given name
+ * (json, ndjson, cbor or msgpack) and returns whether there is such format.
+ */
+bool ParseOutputFormat(const std::string& name, OutputFormat& format);
+
+}  // namespace detail
+
+template <class P, class>
+json Simulate(P& branchPredictor, const SimArgs& args) {
+  SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+  detail::SimStats stats{
+      detail::BranchTable<detail::BranchInfo>(trace)};
+
+  detail::ResultCache cache(args, trace, branchPredictor.metadata_stats());
+  if (cache.enabled()) {
+    json cached = cache.load();
+    if (!cached.is_null()) {
+      return detail::SendCachedIntervals(args, std::move(cached));
+    }
+  }
+
+  detail::WarmupSnapshot snapshot(args, trace,
+                                  branchPredictor.metadata_stats());
+
+  // The last interval ends with the simulation.
+  int64_t endInstr =
+      args.simInstr == 0 ? trace.numInstructions() : args.stopAtInstr;
+  detail::IntervalRecorder intervals(args, endInstr, stats);
+  detail::PhaseProfiler profiler(args.profilePeriod);
+  // Instruction number of the last branch simulated.
+  int64_t lastInstr = 0;
+  // Only the enabled features are checked for each branch.
+  auto simulate = [&](auto&& beforeSimulated) {
+    auto beforeBranch = [&](int64_t instrNum) {
+      lastInstr = instrNum;
+      beforeSimulated(instrNum);
+    };
+    if (args.profilePeriod != 0) {
+      return detail::ProfileBranches(
+          branchPredictor, trace, args.warmupInstrs, args.stopAtInstr, stats,
+          profiler, [&](int64_t instrNum) {
+            beforeBranch(instrNum);
+            if (args.intervalInstrs != 0) intervals(instrNum);
+          });
+    }
+    if (args.intervalInstrs == 0) {
+      return detail::SimulateBranches(branchPredictor, trace,
+                                      args.warmupInstrs, args.stopAtInstr,
+                                      stats, beforeBranch);
+    }
+    return detail::SimulateBranches(
+        branchPredictor, trace, args.warmupInstrs, args.stopAtInstr, stats,
+        [&](int64_t instrNum) {
+          beforeBranch(instrNum);
+          intervals(instrNum);
+        });
+  };
+
+  detail::HostCounters hostCounters(args.hostCounters);
+  // Instruction of the trace where the simulation starts.
+  int64_t firstInstr = 0;
+  auto startTime = std::chrono::high_resolution_clock::now();
+  hostCounters.start();
+  bool exhaustedTrace;
+  if (snapshot.enabled() && snapshot.load(branchPredictor)) {
+    trace.seek(args.warmupInstrs);
+    firstInstr = args.warmupInstrs;
+    exhaustedTrace = simulate([](int64_t) {});
+  } else if (snapshot.enabled()) {
+    bool saved = false;
+    exhaustedTrace = simulate([&](int64_t instrNum) {
+      if (!saved && instrNum >= args.warmupInstrs) {
+        saved = true;
+        snapshot.save(branchPredictor);
+      }
+    });
+  } else {
+    exhaustedTrace = simulate([](int64_t) {});
+  }
+  hostCounters.stop();
+  intervals.finish();
+  detail::TraceRun run = detail::EndTraceRun(trace, exhaustedTrace, startTime);
+  json output = detail::SimulateReport(args, run, stats,
+                                       branchPredictor.metadata_stats(),
+                                       branchPredictor.execution_stats());
+  if (args.profilePeriod != 0) output["profile"] = profiler.report();
+  if (args.hostCounters) {
+    // The trace is read in batches, which can go past the last branch.
+    output["host_counters"] =
+        hostCounters.report(std::max(lastInstr, firstInstr) - firstInstr);
+  }
+  if (cache.enabled()) cache.save(output);
+  // The intervals were already passed to the sink.
+  if (args.intervalSink) output.erase("intervals");
+  return output;
+}
+
+template <class... P, class>
+json ParallelSim(std::tuple<P...>& predictors, const SimArgs& args) {
+  constexpr size_t numPredictors = sizeof...(P);
+  SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+  int64_t numBranches = 0;
+  std::vector<int64_t> mispredictions(numPredictors);
+
+  detail::HostCounters hostCounters(args.hostCounters);
+  auto startTime = std::chrono::high_resolution_clock::now();
+  hostCounters.start();
+  bool exhaustedTrace;
+  if (args.threads > 1 && numPredictors > 1) {
+    exhaustedTrace = detail::ParallelForEachChunk(
+        trace, args.warmupInstrs, args.stopAtInstr, numPredictors,
+        args.threads, numBranches,
+        [&](size_t i, const BranchArrays& chunk, size_t size) {
+          auto simulate = [&](auto& predictor) {
+            mispredictions[i] += detail::SimulateChunk(predictor, chunk, size,
+                                                       args.warmupInstrs);
+          };
+          detail::VisitAt(predictors, i, simulate,
+                          std::index_sequence_for<P...>{});
+        });
+  } else {
+    exhaustedTrace = detail::ForEachBranch(
+        trace, args.stopAtInstr, [&](const Branch& b, int64_t instrNum) {
+          bool measured = b.isConditional() && instrNum >= args.warmupInstrs;
+          numBranches += measured;
+          std::apply(
+              [&](auto&... predictor) {
+                size_t i = 0;
+                ((mispredictions[i++] +=
+                  detail::SimulateBranch(predictor, b) && measured),
+                 ...);
+              },
+              predictors);
+        });
+  }
+  hostCounters.stop();
+  detail::TraceRun run = detail::EndTraceRun(trace, exhaustedTrace, startTime);
+  auto [metadata, executionStats] = std::apply(
+      [](const auto&... predictor) {
+        return std::make_pair(
+            std::vector<json>{predictor.metadata_stats()...},
+            std::vector<json>{predictor.execution_stats()...});
+      },
+      predictors);
+  json output = detail::ParallelSimReport(args, run, numBranches,
+                                          mispredictions, std::move(metadata),
+                                          std::move(executionStats));
+  if (args.hostCounters) {
+    // The trace is read in chunks, which can go past stopAtInstr,
+    // and the simulation starts at the beginning of the trace.
+    output["host_counters"] =
+        hostCounters.report(std::min(run.lastInstrRead, args.stopAtInstr));
+  }
+  return output;
+}
+
+template <class P0, class P1, class>
+json Compare(P0& predictor0, P1& predictor1, const SimArgs& args) {
+  SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+  detail::BranchTable<detail::CompareInfo> branchInfo(trace);
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  bool exhaustedTrace = detail::ForEachBranch(
+      trace, args.stopAtInstr, [&](const Branch& b, int64_t instrNum) {
+        int wasMisp0 = detail::SimulateBranch(predictor0, b);
+        int wasMisp1 = detail::SimulateBranch(predictor1, b);
+        if (b.isConditional() && instrNum >= args.warmupInstrs) {
+          branchInfo[b][(wasMisp1 << 1) | wasMisp0] += 1;
+        }
+      });
+  detail::TraceRun run = detail::EndTraceRun(trace, exhaustedTrace, startTime);
+  return detail::CompareReport(
+      args, run, branchInfo,
+      {predictor0.metadata_stats(), predictor1.metadata_stats()},
+      {predictor0.execution_stats(), predictor1.execution_stats()});
+}
+
+template <class P, class>
+int SimMain(int argc, char** argv, P& branchPredictor) {
+  SimArgs args = ParseCmdLineArgs(argc, argv);
+  detail::PrintIntervalsAsTheyEnd(args);
+  return detail::PrintReport(Simulate(branchPredictor, args), args);
+}
+
+template <class P0, class P1, class>
+int CompareMain(int argc, char** argv, P0& predictor0, P1& predictor1) {
+  SimArgs args = ParseCmdLineArgs(argc, argv);
+  return detail::PrintReport(Compare(predictor0, predictor1, args), args);
+}
+
+}  // namespace mbp
+
+#endif  // MBP_SIMULATOR_IMPL_HPP_
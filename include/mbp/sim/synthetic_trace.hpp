@@ -0,0 +1,134 @@
+#ifndef MBP_SYNTHETIC_TRACE_HPP_
+#define MBP_SYNTHETIC_TRACE_HPP_
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "mbp/core/branch.hpp"
+#include "mbp/core/predictor.hpp"
+
+namespace mbp {
+
+/**
+ * Parameters of the workload model of SyntheticTrace.
+ */
+struct SyntheticTraceOptions {
+  // Seed of the model and the outcomes.
+  uint64_t seed = 0;
+  // Number of static branches, including calls and returns.
+  int numStaticBranches = 1024;
+  // Number of functions among which the static branches are divided.
+  int numFunctions = 16;
+  // Fraction of the static branches that call a function.
+  double callFraction = 0.05;
+  // Fraction of the calls that are indirect,
+  // each with up to maxIndirectTargets targets,
+  // chosen according to the last outcomes.
+  double indirectFraction = 0.2;
+  int maxIndirectTargets = 4;
+  // Fraction of the static branches that close a loop,
+  // which are taken tripCount - 1 times and then not taken.
+  double loopFraction = 0.2;
+  // The trip counts of the loops are uniformly distributed
+  // between 2 and maxTripCount.
+  int maxTripCount = 16;
+  // Fraction of the static branches whose outcome is the XOR
+  // of two of the last correlationDepth outcomes.
+  double correlatedFraction = 0.3;
+  int correlationDepth = 8;
+  // The rest of conditional branches go in their preferred direction
+  // with a probability uniformly distributed between minBias and 1.
+  double minBias = 0.9;
+  // Mean number of instructions per branch, at least 1.
+  double instrPerBranch = 5;
+};
+
+/**
+ * Infinite stream of branches of a synthetic workload.
+ *
+ * The static branches are divided in functions, laid out sequentially.
+ * Each function ends with a return, except the first one,
+ * which is the entry point and jumps back to its start.
+ * Functions only call the functions after them, so there is no recursion.
+ * The branches of a function are executed in order,
+ * except that taken branches jump to their target:
+ * loop branches jump back to the start of their body,
+ * which contains no other loops, and the rest of conditional branches
+ * jump a few branches forward, without leaving the function.
+ *
+ * The stream only depends on the options,
+ * so the same options always produce the same branches.
+ */
+class SyntheticTrace {
+ public:
+  explicit SyntheticTrace(const SyntheticTraceOptions& options);
+
+  /**
+   * Generates the next branch and returns its instruction number.
+   *
+   * The static identifier of the branch is its index
+   * among the numStaticBranches of the model.
+   */
+  int64_t nextBranch(Branch& b);
+
+  /**
+   * Returns the options of the model.
+   */
+  json metadata() const;
+
+ private:
+  enum class Kind {
+    BIASED,
+    LOOP,
+    CORRELATED,
+    CALL,
+    INDIRECT_CALL,
+    RETURN,
+    // Jump to the start of the entry point.
+    RESTART,
+  };
+
+  struct StaticBranch {
+    Kind kind;
+    // Index of the static branch executed when the branch is taken,
+    // or of the targets in indirectTargets_, for indirect calls.
+    int target;
+    // Probability of taken, for biased branches,
+    // or trip count, for loops.
+    double param;
+    // Outcomes (counting from the last one) XORed by correlated branches.
+    int lag0, lag1;
+    // Number of times that a loop was taken since it was last not taken.
+    int iteration;
+  };
+
+  /**
+   * Returns a random number in [0, 1).
+   */
+  double uniform();
+
+  /**
+   * Returns the address of a static branch.
+   */
+  static uint64_t address(int idx);
+
+  SyntheticTraceOptions options_;
+  // Independent of the C++ library, unlike the standard distributions.
+  std::mt19937_64 rng_;
+  std::vector<StaticBranch> branches_;
+  // Index of the first static branch of each function.
+  std::vector<int> functionStart_;
+  // Targets of the indirect calls.
+  std::vector<std::vector<int>> indirectTargets_;
+  // Indices of the branches where the active calls return.
+  std::vector<int> returnStack_;
+  int next_;
+  int64_t instrNum_;
+  // Last outcomes, the last one in the least significant bit.
+  uint64_t history_;
+};
+
+}  // namespace mbp
+
+#endif  // MBP_SYNTHETIC_TRACE_HPP_
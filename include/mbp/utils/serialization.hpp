@@ -0,0 +1,115 @@
+#ifndef MBP_SERIALIZATION_HPP_
+#define MBP_SERIALIZATION_HPP_
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mbp {
+
+/**
+ * Helpers to implement Predictor::serialize and Predictor::deserialize.
+ *
+ * Serialize(os, x0, x1, ...) writes its arguments in binary
+ * and Deserialize(is, x0, x1, ...) reads them back in the same order.
+ * Trivially copyable objects (integers, saturated counters, std::array
+ * and std::bitset of them, BitStreamXorFold, etc.) are copied as is,
+ * vectors are stored with their size, and random number engines
+ * are stored with their stream operators.
+ *
+ * The format is meant for snapshots that are read by the same build,
+ * so it does not take care of endianness or padding.
+ * Deserialize throws std::runtime_error if the stream ends prematurely.
+ */
+template <class T>
+void Serialize(std::ostream& os, const T& x);
+
+template <class T>
+void Deserialize(std::istream& is, T& x);
+
+template <class T>
+void Serialize(std::ostream& os, const std::vector<T>& v) {
+  uint64_t size = v.size();
+  Serialize(os, size);
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    os.write(reinterpret_cast<const char*>(v.data()), size * sizeof(T));
+  } else {
+    for (const T& x : v) Serialize(os, x);
+  }
+}
+
+template <class T>
+void Deserialize(std::istream& is, std::vector<T>& v) {
+  uint64_t size;
+  Deserialize(is, size);
+  v.resize(size);
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    is.read(reinterpret_cast<char*>(v.data()), size * sizeof(T));
+    if (!is) throw std::runtime_error("Deserialize: unexpected end of stream");
+  } else {
+    for (T& x : v) Deserialize(is, x);
+  }
+}
+
+template <class UIntType, size_t W, size_t N, size_t M, size_t R,
+          UIntType A, size_t U, UIntType D, size_t S, UIntType B, size_t T,
+          UIntType C, size_t L, UIntType F>
+void Serialize(std::ostream& os,
+               const std::mersenne_twister_engine<UIntType, W, N, M, R, A, U,
+                                                  D, S, B, T, C, L, F>& rng) {
+  std::ostringstream state;
+  state << rng;
+  std::string str = state.str();
+  Serialize(os, std::vector<char>(str.begin(), str.end()));
+}
+
+template <class UIntType, size_t W, size_t N, size_t M, size_t R,
+          UIntType A, size_t U, UIntType D, size_t S, UIntType B, size_t T,
+          UIntType C, size_t L, UIntType F>
+void Deserialize(std::istream& is,
+                 std::mersenne_twister_engine<UIntType, W, N, M, R, A, U, D,
+                                              S, B, T, C, L, F>& rng) {
+  std::vector<char> text;
+  Deserialize(is, text);
+  std::istringstream state(std::string(text.begin(), text.end()));
+  state >> rng;
+  if (!state) throw std::runtime_error("Deserialize: invalid engine state");
+}
+
+template <class T>
+void Serialize(std::ostream& os, const T& x) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Serialize: type without a binary representation");
+  os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template <class T>
+void Deserialize(std::istream& is, T& x) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Deserialize: type without a binary representation");
+  is.read(reinterpret_cast<char*>(&x), sizeof(T));
+  if (!is) throw std::runtime_error("Deserialize: unexpected end of stream");
+}
+
+template <class T0, class T1, class... Ts>
+void Serialize(std::ostream& os, const T0& x0, const T1& x1,
+               const Ts&... xs) {
+  Serialize(os, x0);
+  Serialize(os, x1, xs...);
+}
+
+template <class T0, class T1, class... Ts>
+void Deserialize(std::istream& is, T0& x0, T1& x1, Ts&... xs) {
+  Deserialize(is, x0);
+  Deserialize(is, x1, xs...);
+}
+
+}  // namespace mbp
+
+#endif  // MBP_SERIALIZATION_HPP_
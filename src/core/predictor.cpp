@@ -1,3 +1,5 @@
+#include <stdexcept>
+
 #include "mbp/core/predictor.hpp"
 #include "nlohmann/json.hpp"
 
@@ -7,4 +9,12 @@ json Predictor::metadata_stats() const { return json::object(); }
 
 json Predictor::execution_stats() const { return json::object(); }
 
+void Predictor::serialize(std::ostream& os) const {
+  throw std::logic_error("Predictor: serialize is not implemented");
+}
+
+void Predictor::deserialize(std::istream& is) {
+  throw std::logic_error("Predictor: deserialize is not implemented");
+}
+
 }  // namespace mbp
@@ -0,0 +1,597 @@
+#ifndef MBP_DYNAMIC_PREDICTORS_HPP_
+#define MBP_DYNAMIC_PREDICTORS_HPP_
+
+// Versions of the example predictors whose sizes are set at runtime.
+// Each one behaves exactly like the template with the same parameters
+// and has the same metadata and snapshots, but its tables are accessed
+// through pointers and its histories are masked integers instead of bitsets,
+// so the registry uses them only for the parameters that it does not
+// instantiate.
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "mbp/core/predictor.hpp"
+#include "mbp/utils/indexing.hpp"
+#include "mbp/utils/saturated_reg.hpp"
+#include "mbp/utils/serialization.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+/**
+ * Returns a mask of the n least significant bits (n <= 64).
+ */
+constexpr uint64_t LowBitsMask(int n) {
+  return n >= 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+}
+
+/**
+ * Writes the elements of v like Serialize writes a std::array.
+ */
+template <class T>
+void SerializeArray(std::ostream& os, const std::vector<T>& v) {
+  os.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+}
+
+/**
+ * Reads the elements of v like Deserialize reads a std::array.
+ */
+template <class T>
+void DeserializeArray(std::istream& is, std::vector<T>& v) {
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (!is) throw std::runtime_error("Deserialize: unexpected end of stream");
+}
+
+/**
+ * Writes a history of n bits (n <= 64) like Serialize writes a std::bitset.
+ */
+inline void SerializeHistory(std::ostream& os, uint64_t history, int n) {
+  static_assert(sizeof(std::bitset<64>) == sizeof(uint64_t));
+  if (n == 0) {
+    Serialize(os, std::bitset<0>());
+  } else {
+    Serialize(os, history);
+  }
+}
+
+/**
+ * Reads a history of n bits like Deserialize reads a std::bitset.
+ */
+inline void DeserializeHistory(std::istream& is, uint64_t& history, int n) {
+  if (n == 0) {
+    std::bitset<0> empty;
+    Deserialize(is, empty);
+    history = 0;
+  } else {
+    Deserialize(is, history);
+  }
+}
+
+/**
+ * Nmodal<N, T> with T set at runtime.
+ */
+template <int N>
+struct DynamicNmodal : Predictor {
+  int logTableSize;
+  std::vector<SatCtr<N>> table;
+
+  explicit DynamicNmodal(int logTableSize)
+      : logTableSize(logTableSize), table(size_t{1} << logTableSize) {}
+
+  uint64_t hash(uint64_t ip) const { return ip & LowBitsMask(logTableSize); }
+
+  bool predict(uint64_t ip) override { return table[hash(ip)] >= 0; }
+
+  void train(const Branch& b) override {
+    table[hash(b.ip())].sumOrSub(b.isTaken());
+  }
+
+  void track(const Branch& b) override {}
+
+  void serialize(std::ostream& os) const override { SerializeArray(os, table); }
+
+  void deserialize(std::istream& is) override { DeserializeArray(is, table); }
+
+  json metadata_stats() const override {
+    return {
+        {"name", "MBPlib Nmodal"},
+        {"counter_bits", N},
+        {"log_table_size", logTableSize},
+    };
+  }
+};
+
+/**
+ * Bimodal<T> with T set at runtime.
+ */
+struct DynamicBimodal : DynamicNmodal<2> {
+  using DynamicNmodal::DynamicNmodal;
+
+  json metadata_stats() const override {
+    return {
+        {"name", "MBPlib Bimodal"},
+        {"log_table_size", logTableSize},
+    };
+  }
+};
+
+/**
+ * Gshare<H, T, IGNORE_UCD> with the parameters set at runtime.
+ */
+struct DynamicGshare : Predictor {
+  int histLen;
+  int logTableSize;
+  bool ignoreUcd;
+  std::vector<i2> table;
+  uint64_t ghist;
+
+  DynamicGshare(int histLen, int logTableSize, bool ignoreUcd)
+      : histLen(histLen),
+        logTableSize(logTableSize),
+        ignoreUcd(ignoreUcd),
+        table(size_t{1} << logTableSize),
+        ghist(0) {}
+
+  uint64_t hash(uint64_t ip) const {
+    return XorFold(ip ^ (ghist << (logTableSize - (histLen % logTableSize))),
+                   logTableSize);
+  }
+
+  bool predict(uint64_t ip) override { return table[hash(ip)] >= 0; }
+
+  void train(const Branch& b) override {
+    table[hash(b.ip())].sumOrSub(b.isTaken());
+  }
+
+  void track(const Branch& b) override {
+    if (!b.isConditional() && ignoreUcd) return;
+    ghist = ((ghist << 1) | b.isTaken()) & LowBitsMask(histLen);
+  }
+
+  void serialize(std::ostream& os) const override {
+    SerializeArray(os, table);
+    SerializeHistory(os, ghist, histLen);
+  }
+
+  void deserialize(std::istream& is) override {
+    DeserializeArray(is, table);
+    DeserializeHistory(is, ghist, histLen);
+  }
+
+  json metadata_stats() const override {
+    return {
+        {"name", "MBPlib Gshare"},
+        {"history_length", histLen},
+        {"log_table_size", logTableSize},
+        {"track_only_conditional", ignoreUcd},
+    };
+  }
+};
+
+/**
+ * TwoLevel<HLEN, HNUM, HSET, PNUM, PSET> with the parameters set at runtime.
+ */
+struct DynamicTwoLevel : Predictor {
+  int histLen, logNumBhr, logSetBhr, logNumPht, logSetPht;
+  std::vector<uint64_t> bhr;
+  std::vector<i2> phr;
+
+  DynamicTwoLevel(int histLen, int logNumBhr, int logSetBhr, int logNumPht,
+                  int logSetPht)
+      : histLen(histLen),
+        logNumBhr(logNumBhr),
+        logSetBhr(logSetBhr),
+        logNumPht(logNumPht),
+        logSetPht(logSetPht),
+        bhr(size_t{1} << logNumBhr),
+        phr(size_t{1} << (logNumPht + histLen)) {}
+
+  uint64_t bhrHash(uint64_t ip) const {
+    return (ip >> logSetBhr) & LowBitsMask(logNumBhr);
+  }
+
+  uint64_t phrHash(uint64_t ip) const {
+    return (((ip >> logSetPht) & LowBitsMask(logNumPht)) << histLen) |
+           bhr[bhrHash(ip)];
+  }
+
+  bool predict(uint64_t ip) override { return phr[phrHash(ip)] >= 0; }
+
+  void train(const Branch& b) override {
+    phr[phrHash(b.ip())].sumOrSub(b.isTaken());
+  }
+
+  void track(const Branch& b) override {
+    uint64_t& h = bhr[bhrHash(b.ip())];
+    h = ((h << 1) | b.isTaken()) & LowBitsMask(histLen);
+  }
+
+  void serialize(std::ostream& os) const override {
+    for (uint64_t h : bhr) SerializeHistory(os, h, histLen);
+    SerializeArray(os, phr);
+  }
+
+  void deserialize(std::istream& is) override {
+    for (uint64_t& h : bhr) DeserializeHistory(is, h, histLen);
+    DeserializeArray(is, phr);
+  }
+
+  json metadata_stats() const override {
+    // clang-format off
+    return {
+        {"name", "MBPlib Two Level"},
+        {"history_length", histLen},
+        {"log_num_bhr", logNumBhr},
+        {"log_set_bhr", logSetBhr},
+        {"log_num_pht", logNumPht},
+        {"log_set_pht", logSetPht},
+        {"log_table_size", logNumPht + histLen},
+    };
+    // clang-format on
+  }
+};
+
+/**
+ * Twobcgskew<BT, G0T, G1T, MT, G0H, G1H, MH> with the parameters
+ * set at runtime.
+ */
+struct DynamicTwobcgskew : Predictor {
+  int bimLogSize, g0LogSize, g1LogSize, metaLogSize;
+  int g0HistLen, g1HistLen, metaHistLen;
+  // Components
+  std::vector<i2> bim, g0, g1, meta;
+  uint64_t ghist;
+  // Saved Values
+  uint64_t predictedIp, bimIdx, g0Idx, g1Idx, metaIdx;
+  bool bimPred, g0Pred, g1Pred, metaPred;
+  bool majorityVote, prediction, tracked = true;
+
+  DynamicTwobcgskew(int bimLogSize, int g0LogSize, int g1LogSize,
+                    int metaLogSize, int g0HistLen, int g1HistLen,
+                    int metaHistLen)
+      : bimLogSize(bimLogSize),
+        g0LogSize(g0LogSize),
+        g1LogSize(g1LogSize),
+        metaLogSize(metaLogSize),
+        g0HistLen(g0HistLen),
+        g1HistLen(g1HistLen),
+        metaHistLen(metaHistLen),
+        bim(size_t{1} << bimLogSize),
+        g0(size_t{1} << g0LogSize),
+        g1(size_t{1} << g1LogSize),
+        meta(size_t{1} << metaLogSize),
+        ghist(0) {}
+
+  bool predict(uint64_t ip) override {
+    if (tracked == false && predictedIp == ip) return prediction;
+    tracked = false;
+    predictedIp = ip;
+
+    bimIdx = XorFold(ip, bimLogSize);
+    g0Idx = XorFold(ip ^ (ghist & LowBitsMask(g0HistLen)), g0LogSize);
+    g1Idx = XorFold(ip ^ (ghist & LowBitsMask(g1HistLen)), g1LogSize);
+    metaIdx = XorFold(ip ^ (ghist & LowBitsMask(metaHistLen)), metaLogSize);
+    bimPred = bim[bimIdx] >= 0;
+    g0Pred = g0[g0Idx] >= 0;
+    g1Pred = g1[g1Idx] >= 0;
+    metaPred = meta[metaIdx] >= 0;
+    majorityVote = g0Pred == g1Pred ? g0Pred : bimPred;
+    prediction = metaPred ? majorityVote : bimPred;
+    return prediction;
+  }
+
+  void train(const Branch& b) override {
+    // See Twobcgskew::train.
+    predict(b.ip());
+    if (majorityVote != bimPred) {
+      meta[metaIdx].sumOrSub(majorityVote == b.isTaken());
+    } else if (prediction == b.isTaken()) {
+      meta[metaIdx].sumOrSub(metaPred);
+    }
+    bool newMetapred = meta[metaIdx] >= 0;
+    bool newPrediction = newMetapred ? majorityVote : bimPred;
+    if (newPrediction != b.isTaken()) {
+      bim[bimIdx].sumOrSub(b.isTaken());
+      g0[g0Idx].sumOrSub(b.isTaken());
+      g1[g1Idx].sumOrSub(b.isTaken());
+      return;
+    }
+    if (bimPred == g0Pred and bimPred == g1Pred) return;
+    if (metaPred) {
+      if (g0Pred == b.isTaken()) g0[g0Idx].sumOrSub(g0Pred);
+      if (g1Pred == b.isTaken()) g1[g1Idx].sumOrSub(g1Pred);
+      if (bimPred == b.isTaken()) bim[bimIdx].sumOrSub(bimPred);
+    } else {
+      bim[bimIdx].sumOrSub(bimPred);
+    }
+  }
+
+  void track(const Branch& b) override {
+    ghist = ((ghist << 1) | b.isTaken()) & LowBitsMask(histLen());
+    tracked = true;
+  }
+
+  int histLen() const {
+    return std::max(std::max(g0HistLen, g1HistLen), metaHistLen);
+  }
+
+  void serialize(std::ostream& os) const override {
+    for (const auto* table : {&bim, &g0, &g1, &meta}) {
+      SerializeArray(os, *table);
+    }
+    SerializeHistory(os, ghist, histLen());
+  }
+
+  void deserialize(std::istream& is) override {
+    for (auto* table : {&bim, &g0, &g1, &meta}) DeserializeArray(is, *table);
+    DeserializeHistory(is, ghist, histLen());
+    tracked = true;
+  }
+
+  json metadata_stats() const override {
+    return {
+        {"name", "MBPlib 2bcgskew"},
+        {"bimodal",
+         {
+             {"log_table_size", bimLogSize},
+         }},
+        {"gshare_0",
+         {
+             {"history_length", g0HistLen},
+             {"log_table_size", g0LogSize},
+         }},
+        {"gshare_1",
+         {
+             {"history_length", g1HistLen},
+             {"log_table_size", g1LogSize},
+         }},
+        {"metapredictor",
+         {
+             {"history_length", metaHistLen},
+             {"log_table_size", metaLogSize},
+         }},
+    };
+  }
+};
+
+/**
+ * HashedPerceptron<MINH, NUMT, T, MISP_THRESH> with the parameters
+ * set at runtime.
+ */
+struct DynamicHashedPerceptron : Predictor {
+  int minHistLen, numTables, logTablesSize, mispThreshold;
+  // Components
+  std::vector<std::vector<i8>> component;
+  std::vector<int> hlen;
+  std::vector<BitStreamXorFold> ghistFold;
+  std::vector<char> ghist;
+  size_t ghistIdx;
+  int theta;
+  int misp;
+  // Saved Values
+  std::vector<uint64_t> idx;
+  int sum;
+  bool prediction;
+  bool tracked;
+  uint64_t predictedIp;
+
+  DynamicHashedPerceptron(int minHistLen, int numTables, int logTablesSize,
+                          int mispThreshold)
+      : minHistLen(minHistLen),
+        numTables(numTables),
+        logTablesSize(logTablesSize),
+        mispThreshold(mispThreshold),
+        component(numTables, std::vector<i8>(size_t{1} << logTablesSize)),
+        hlen(numTables),
+        ghistFold(numTables),
+        ghistIdx(0),
+        theta(10),
+        misp(0),
+        idx(numTables),
+        sum(0),
+        prediction(false),
+        tracked(true),
+        predictedIp(0) {
+    // The same lengths as in HashedPerceptron.
+    const double phi = (1 + std::sqrt(5.0)) / 2;
+    const double geomRatio = std::pow(phi, 1 / phi);
+    int histLen =
+        2 + minHistLen * std::pow(geomRatio, std::max(numTables - 2, 0));
+    ghist.resize(histLen);
+    hlen[0] = 0;
+    ghistFold[0] = BitStreamXorFold(hlen[0], logTablesSize);
+    double power = minHistLen;
+    for (int i = 1; i < numTables; ++i) {
+      hlen[i] = power;
+      ghistFold[i] = BitStreamXorFold(hlen[i], logTablesSize);
+      power *= geomRatio;
+    }
+  }
+
+  bool predict(uint64_t ip) override {
+    if (tracked == false && predictedIp == ip) return prediction;
+    tracked = false;
+    predictedIp = ip;
+
+    sum = 0;
+    uint64_t ipfold = XorFold(ip, logTablesSize);
+    for (size_t i = 0; i < component.size(); ++i) {
+      idx[i] = ipfold ^ ghistFold[i].fold();
+      sum += static_cast<int>(component[i][idx[i]]);
+    }
+    return prediction = sum > 0;
+  }
+
+  void train(const Branch& b) override {
+    predict(b.ip());
+
+    if (b.isTaken() == prediction && std::abs(sum) >= theta) return;
+    for (size_t i = 0; i < component.size(); ++i) {
+      component[i][idx[i]].sumOrSub(b.isTaken());
+    }
+    if (b.isTaken() != prediction) {
+      if (++misp >= mispThreshold) {
+        misp = 0;
+        theta++;
+      }
+    } else {
+      if (--misp <= -mispThreshold) {
+        misp = 0;
+        theta--;
+      }
+    }
+  }
+
+  void track(const Branch& b) override {
+    ghistIdx = (ghistIdx == 0 ? ghist.size() : ghistIdx) - 1U;
+    ghist[ghistIdx] = b.isTaken();
+    for (int i = 0; i < numTables; ++i) {
+      unsigned outgoingBit = ghist[(ghistIdx + hlen[i]) % ghist.size()];
+      ghistFold[i].shiftInAndOut(1, b.isTaken(), outgoingBit);
+    }
+    tracked = true;
+  }
+
+  void serialize(std::ostream& os) const override {
+    for (const std::vector<i8>& table : component) SerializeArray(os, table);
+    SerializeArray(os, ghistFold);
+    SerializeArray(os, ghist);
+    Serialize(os, ghistIdx, theta, misp);
+  }
+
+  void deserialize(std::istream& is) override {
+    for (std::vector<i8>& table : component) DeserializeArray(is, table);
+    DeserializeArray(is, ghistFold);
+    DeserializeArray(is, ghist);
+    Deserialize(is, ghistIdx, theta, misp);
+    tracked = true;
+  }
+
+  json metadata_stats() const override {
+    return {
+        {"name", "MBPlib Hashed Perceptron"},
+        {"min_history_length", minHistLen},
+        {"num_tables", numTables},
+        {"log_tables_size", logTablesSize},
+        {"mispredictions_threshold", mispThreshold},
+    };
+  }
+};
+
+/**
+ * BimodalTournament<BP0, BP1, T> (if histLen is 0)
+ * or GshareTournament<BP0, BP1, H, T> (otherwise)
+ * with components and parameters set at runtime.
+ */
+struct DynamicTournament : Predictor {
+  std::unique_ptr<Predictor> bp0;
+  std::unique_ptr<Predictor> bp1;
+  bool gshareMeta;
+  int histLen;
+  int logTableSize;
+  std::vector<i2> bimTable;
+  std::vector<i3> gshareTable;
+  uint64_t ghist;
+  bool pred0, pred1, prediction, provider;
+
+  DynamicTournament(std::unique_ptr<Predictor> bp0,
+                    std::unique_ptr<Predictor> bp1, bool gshareMeta,
+                    int histLen, int logTableSize)
+      : bp0(std::move(bp0)),
+        bp1(std::move(bp1)),
+        gshareMeta(gshareMeta),
+        histLen(histLen),
+        logTableSize(logTableSize),
+        bimTable(gshareMeta ? 0 : size_t{1} << logTableSize),
+        gshareTable(gshareMeta ? size_t{1} << logTableSize : 0),
+        ghist(0) {}
+
+  uint64_t hash(uint64_t ip) const {
+    if (!gshareMeta) return XorFold(ip, logTableSize);
+    return RoxFold(ip, logTableSize) ^ XorFold(ghist, logTableSize);
+  }
+
+  bool predict(uint64_t ip) override {
+    pred0 = bp0->predict(ip);
+    pred1 = bp1->predict(ip);
+    if (gshareMeta) {
+      provider = gshareTable[hash(ip)] >= 0;
+    } else {
+      provider = bimTable[hash(ip)] >= 0;
+    }
+    prediction = provider ? pred1 : pred0;
+    return prediction;
+  }
+
+  void train(const Branch& b) override {
+    bp0->train(b);
+    bp1->train(b);
+    if (pred0 != pred1) {
+      if (gshareMeta) {
+        gshareTable[hash(b.ip())].sumOrSub(pred1 == b.isTaken());
+      } else {
+        bimTable[hash(b.ip())].sumOrSub(pred1 == b.isTaken());
+      }
+    }
+  }
+
+  void track(const Branch& b) override {
+    bp0->track(b);
+    bp1->track(b);
+    if (gshareMeta) {
+      ghist = ((ghist << 1) | b.isTaken()) & LowBitsMask(histLen);
+    }
+  }
+
+  void serialize(std::ostream& os) const override {
+    if (gshareMeta) {
+      SerializeArray(os, gshareTable);
+      SerializeHistory(os, ghist, histLen);
+    } else {
+      SerializeArray(os, bimTable);
+    }
+    bp0->serialize(os);
+    bp1->serialize(os);
+  }
+
+  void deserialize(std::istream& is) override {
+    if (gshareMeta) {
+      DeserializeArray(is, gshareTable);
+      DeserializeHistory(is, ghist, histLen);
+    } else {
+      DeserializeArray(is, bimTable);
+    }
+    bp0->deserialize(is);
+    bp1->deserialize(is);
+  }
+
+  json metadata_stats() const override {
+    if (!gshareMeta) {
+      return {
+          {"name", "MBPlib Bimodal Tournament"},
+          {"log_table_size", logTableSize},
+          {"predictor_0", bp0->metadata_stats()},
+          {"predictor_1", bp1->metadata_stats()},
+      };
+    }
+    return {
+        {"name", "MBPlib Gshare Tournament"},
+        {"history_length", histLen},
+        {"log_table_size", logTableSize},
+        {"predictor_0", bp0->metadata_stats()},
+        {"predictor_1", bp1->metadata_stats()},
+    };
+  }
+};
+
+}  // namespace mbp
+
+#endif  // MBP_DYNAMIC_PREDICTORS_HPP_
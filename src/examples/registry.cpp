@@ -0,0 +1,369 @@
+#include "mbp/examples/registry.hpp"
+
+#include <array>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dynamic_predictors.hpp"
+#include "mbp/examples/mbp_examples.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+// Ranges of template parameters that are precompiled.
+// The instantiations are compiled only once, with the library,
+// but each one adds to its compilation time and size.
+constexpr int MIN_BIMODAL_LOG_SIZE = 8;
+constexpr int MAX_BIMODAL_LOG_SIZE = 24;
+constexpr int MIN_NMODAL_BITS = 2;
+constexpr int MAX_NMODAL_BITS = 4;
+constexpr int MIN_NMODAL_LOG_SIZE = 10;
+constexpr int MAX_NMODAL_LOG_SIZE = 20;
+constexpr int MIN_GSHARE_LOG_SIZE = 12;
+constexpr int MAX_GSHARE_LOG_SIZE = 20;
+constexpr int MIN_GSHARE_HIST_LEN = 8;
+constexpr int MAX_GSHARE_HIST_LEN = 32;
+
+// Largest table of the predictors whose sizes are set at runtime.
+constexpr int MAX_LOG_SIZE = 32;
+
+/**
+ * Returns the name of the predictor described.
+ */
+static std::string Name(const json& description) {
+  if (!description.is_object() || !description.contains("name") ||
+      !description["name"].is_string()) {
+    throw std::invalid_argument(
+        "MakePredictor: the description must be an object with a name");
+  }
+  return description["name"];
+}
+
+/**
+ * Returns the integer parameter key of the description,
+ * which must be in [min, max].
+ * If defaultValue is not empty, the parameter can be omitted.
+ */
+static int IntParam(const json& description, const char* key, int min,
+                    int max, std::optional<int> defaultValue = std::nullopt) {
+  std::string prefix = "MakePredictor: " + Name(description) + ": ";
+  if (!description.contains(key)) {
+    if (defaultValue) return *defaultValue;
+    throw std::invalid_argument(prefix + "missing parameter " + key);
+  }
+  const json& value = description[key];
+  if (!value.is_number_integer() || value < min || value > max) {
+    throw std::invalid_argument(prefix + key + " must be an integer in [" +
+                                std::to_string(min) + ", " +
+                                std::to_string(max) + "]");
+  }
+  return value;
+}
+
+/**
+ * Returns the boolean parameter key of the description,
+ * or defaultValue if it is omitted.
+ */
+static bool BoolParam(const json& description, const char* key,
+                      bool defaultValue) {
+  if (!description.contains(key)) return defaultValue;
+  if (!description[key].is_boolean()) {
+    throw std::invalid_argument("MakePredictor: " + Name(description) + ": " +
+                                key + " must be a boolean");
+  }
+  return description[key];
+}
+
+/**
+ * Returns the object or array parameter key of the description.
+ */
+static const json& JsonParam(const json& description, const char* key) {
+  if (!description.contains(key)) {
+    throw std::invalid_argument("MakePredictor: " + Name(description) +
+                                ": missing parameter " + key);
+  }
+  return description[key];
+}
+
+template <int MIN, class F, int... I>
+static std::unique_ptr<Predictor> DispatchImpl(
+    int value, F& f, std::integer_sequence<int, I...>) {
+  std::unique_ptr<Predictor> predictor;
+  ((value == MIN + I
+        ? (predictor = f(std::integral_constant<int, MIN + I>()), true)
+        : false) ||
+   ...);
+  return predictor;
+}
+
+/**
+ * Returns f(std::integral_constant<int, value>()) if value is in [MIN, MAX],
+ * so that f can use value as a template argument, or nullptr otherwise.
+ */
+template <int MIN, int MAX, class F>
+static std::unique_ptr<Predictor> Dispatch(int value, F&& f) {
+  return DispatchImpl<MIN>(value, f,
+                           std::make_integer_sequence<int, MAX - MIN + 1>());
+}
+
+/**
+ * Returns a new P<V...> if params are equal to V..., or nullptr otherwise.
+ */
+template <template <int...> class P, int... V>
+static std::unique_ptr<Predictor> MakeIfEqual(
+    const std::array<int, sizeof...(V)>& params) {
+  if (params != std::array<int, sizeof...(V)>{V...}) return nullptr;
+  return std::make_unique<P<V...>>();
+}
+
+static std::unique_ptr<Predictor> MakeBimodal(const json& description) {
+  int t = IntParam(description, "log_table_size", 0, MAX_LOG_SIZE, 14);
+  auto predictor =
+      Dispatch<MIN_BIMODAL_LOG_SIZE, MAX_BIMODAL_LOG_SIZE>(t, [](auto t) {
+        return std::make_unique<Bimodal<t>>();
+      });
+  if (predictor) return predictor;
+  return std::make_unique<DynamicBimodal>(t);
+}
+
+static std::unique_ptr<Predictor> MakeNmodal(const json& description) {
+  int n = IntParam(description, "counter_bits", 1, 8);
+  int t = IntParam(description, "log_table_size", 0, MAX_LOG_SIZE, 14);
+  auto predictor =
+      Dispatch<MIN_NMODAL_BITS, MAX_NMODAL_BITS>(n, [t](auto n) {
+        return Dispatch<MIN_NMODAL_LOG_SIZE, MAX_NMODAL_LOG_SIZE>(
+            t, [](auto t) {
+              return std::make_unique<Nmodal<decltype(n)::value, t>>();
+            });
+      });
+  if (predictor) return predictor;
+  return Dispatch<1, 8>(
+      n, [t](auto n) { return std::make_unique<DynamicNmodal<n>>(t); });
+}
+
+static std::unique_ptr<Predictor> MakeGshare(const json& description) {
+  int h = IntParam(description, "history_length", 0, 63, 15);
+  int t = IntParam(description, "log_table_size", 1, MAX_LOG_SIZE, 14);
+  bool ignoreUcd = BoolParam(description, "track_only_conditional", false);
+  if (h + (t - h % t) > 64) {
+    throw std::invalid_argument(
+        "MakePredictor: MBPlib Gshare: the history does not fit in the hash");
+  }
+  if (!ignoreUcd) {
+    auto predictor =
+        Dispatch<MIN_GSHARE_LOG_SIZE, MAX_GSHARE_LOG_SIZE>(t, [h](auto t) {
+          return Dispatch<MIN_GSHARE_HIST_LEN, MAX_GSHARE_HIST_LEN>(
+              h, [](auto h) {
+                return std::make_unique<Gshare<h, decltype(t)::value>>();
+              });
+        });
+    if (predictor) return predictor;
+  }
+  return std::make_unique<DynamicGshare>(h, t, ignoreUcd);
+}
+
+static std::unique_ptr<Predictor> MakeTwoLevel(const json& description) {
+  std::array<int, 5> params = {
+      IntParam(description, "history_length", 0, 63),
+      IntParam(description, "log_num_bhr", 0, MAX_LOG_SIZE),
+      IntParam(description, "log_set_bhr", 0, 63),
+      IntParam(description, "log_num_pht", 0, MAX_LOG_SIZE),
+      IntParam(description, "log_set_pht", 0, 63),
+  };
+  auto [hlen, hnum, hset, pnum, pset] = params;
+  if (hlen + pnum > MAX_LOG_SIZE) {
+    throw std::invalid_argument(
+        "MakePredictor: MBPlib Two Level: the pattern table is too large");
+  }
+  // The configurations of the example simulators.
+  for (auto make : {
+           &MakeIfEqual<TwoLevel, 18, 0, 0, 0, 0>,
+           &MakeIfEqual<TwoLevel, 15, 0, 0, 3, 0>,
+           &MakeIfEqual<TwoLevel, 15, 0, 0, 3, 3>,
+           &MakeIfEqual<TwoLevel, 18, 13, 0, 0, 0>,
+           &MakeIfEqual<TwoLevel, 13, 1, 0, 4, 0>,
+           &MakeIfEqual<TwoLevel, 13, 1, 0, 4, 3>,
+           &MakeIfEqual<TwoLevel, 18, 1, 12, 0, 0>,
+           &MakeIfEqual<TwoLevel, 13, 1, 12, 4, 0>,
+           &MakeIfEqual<TwoLevel, 12, 1, 12, 4, 5>,
+       }) {
+    if (auto predictor = make(params)) return predictor;
+  }
+  return std::make_unique<DynamicTwoLevel>(hlen, hnum, hset, pnum, pset);
+}
+
+static std::unique_ptr<Predictor> MakeTwobcgskew(const json& description) {
+  const json& bim = JsonParam(description, "bimodal");
+  const json& g0 = JsonParam(description, "gshare_0");
+  const json& g1 = JsonParam(description, "gshare_1");
+  const json& meta = JsonParam(description, "metapredictor");
+  for (const json* component : {&bim, &g0, &g1, &meta}) {
+    if (!component->is_object()) {
+      throw std::invalid_argument(
+          "MakePredictor: MBPlib 2bcgskew: the components must be objects");
+    }
+  }
+  // The components do not have names, so the errors refer to the predictor.
+  auto param = [&](const json& component, const char* key, int max,
+                   int defaultValue) {
+    json named = component;
+    named["name"] = description["name"];
+    return IntParam(named, key, 0, max, defaultValue);
+  };
+  std::array<int, 7> params = {
+      param(bim, "log_table_size", MAX_LOG_SIZE, 15),
+      param(g0, "log_table_size", MAX_LOG_SIZE, 16),
+      param(g1, "log_table_size", MAX_LOG_SIZE, 16),
+      param(meta, "log_table_size", MAX_LOG_SIZE, 15),
+      param(g0, "history_length", 63, 17),
+      param(g1, "history_length", 63, 27),
+      param(meta, "history_length", 63, 20),
+  };
+  if (auto predictor =
+          MakeIfEqual<Twobcgskew, 15, 16, 16, 15, 17, 27, 20>(params)) {
+    return predictor;
+  }
+  auto [bt, g0t, g1t, mt, g0h, g1h, mh] = params;
+  return std::make_unique<DynamicTwobcgskew>(bt, g0t, g1t, mt, g0h, g1h, mh);
+}
+
+static std::unique_ptr<Predictor> MakeHashedPerceptron(
+    const json& description) {
+  std::array<int, 4> params = {
+      IntParam(description, "min_history_length", 0, 1024),
+      IntParam(description, "num_tables", 1, 64),
+      IntParam(description, "log_tables_size", 0, MAX_LOG_SIZE),
+      IntParam(description, "mispredictions_threshold", 1, 1 << 20, 18),
+  };
+  if (auto predictor = MakeIfEqual<HashedPerceptron, 4, 16, 12, 18>(params)) {
+    return predictor;
+  }
+  auto [minh, numt, t, mispThresh] = params;
+  return std::make_unique<DynamicHashedPerceptron>(minh, numt, t, mispThresh);
+}
+
+/**
+ * Returns the tables of a Tage or Batage description.
+ */
+static const json& Tables(const json& description) {
+  const json& tables = JsonParam(description, "tables");
+  if (!tables.is_array() || tables.empty()) {
+    throw std::invalid_argument("MakePredictor: " + Name(description) +
+                                ": tables must be a non-empty array");
+  }
+  for (const json& table : tables) {
+    if (!table.is_object()) {
+      throw std::invalid_argument("MakePredictor: " + Name(description) +
+                                  ": each table must be an object");
+    }
+  }
+  return tables;
+}
+
+static std::unique_ptr<Predictor> MakeTage(const json& description) {
+  std::vector<Tage::TableSpec> specs;
+  for (json table : Tables(description)) {
+    table["name"] = description["name"];
+    specs.push_back({
+        static_cast<unsigned>(IntParam(table, "history_length", 0, 4096)),
+        static_cast<unsigned>(IntParam(table, "log_size", 0, MAX_LOG_SIZE)),
+        static_cast<unsigned>(IntParam(table, "tag_width", 0, 31)),
+        static_cast<unsigned>(IntParam(table, "counter_width", 1, 31)),
+        static_cast<unsigned>(IntParam(table, "utl_width", 1, 31)),
+    });
+  }
+  return std::make_unique<Tage>(specs);
+}
+
+static std::unique_ptr<Predictor> MakeBatage(const json& description) {
+  std::vector<Batage::TableSpec> specs;
+  for (json table : Tables(description)) {
+    table["name"] = description["name"];
+    specs.push_back({
+        static_cast<uint32_t>(IntParam(table, "history_length", 0, 4096)),
+        static_cast<uint32_t>(IntParam(table, "log_size", 0, MAX_LOG_SIZE)),
+        static_cast<uint32_t>(IntParam(table, "tag_width", 0, 31)),
+    });
+  }
+  int seed = IntParam(description, "seed", std::numeric_limits<int>::min(),
+                      std::numeric_limits<int>::max());
+  return std::make_unique<Batage>(specs, seed);
+}
+
+static std::unique_ptr<Predictor> MakeBimodalTournament(
+    const json& description) {
+  int t = IntParam(description, "log_table_size", 0, MAX_LOG_SIZE, 14);
+  return std::make_unique<DynamicTournament>(
+      MakePredictor(JsonParam(description, "predictor_0")),
+      MakePredictor(JsonParam(description, "predictor_1")), false, 0, t);
+}
+
+static std::unique_ptr<Predictor> MakeGshareTournament(
+    const json& description) {
+  int h = IntParam(description, "history_length", 0, 63, 10);
+  int t = IntParam(description, "log_table_size", 1, MAX_LOG_SIZE, 14);
+  if (h + (t - h % t) >= 64) {
+    throw std::invalid_argument(
+        "MakePredictor: MBPlib Gshare Tournament: "
+        "the history does not fit in the hash");
+  }
+  return std::make_unique<DynamicTournament>(
+      MakePredictor(JsonParam(description, "predictor_0")),
+      MakePredictor(JsonParam(description, "predictor_1")), true, h, t);
+}
+
+static std::unique_ptr<Predictor> MakeTournament(const json& description) {
+  return std::make_unique<TournamentPred>(
+      MakePredictor(JsonParam(description, "metapredictor")),
+      MakePredictor(JsonParam(description, "predictor_0")),
+      MakePredictor(JsonParam(description, "predictor_1")));
+}
+
+/**
+ * Returns the registered builders by name.
+ */
+static std::map<std::string, PredictorBuilder>& Registry() {
+  static std::map<std::string, PredictorBuilder> registry = {
+      {"MBPlib Bimodal", MakeBimodal},
+      {"MBPlib Nmodal", MakeNmodal},
+      {"MBPlib Gshare", MakeGshare},
+      {"MBPlib Two Level", MakeTwoLevel},
+      {"MBPlib 2bcgskew", MakeTwobcgskew},
+      {"MBPlib Hashed Perceptron", MakeHashedPerceptron},
+      {"MBPlib Tage", MakeTage},
+      {"MBPlib Batage", MakeBatage},
+      {"MBPlib Bimodal Tournament", MakeBimodalTournament},
+      {"MBPlib Gshare Tournament", MakeGshareTournament},
+      {"MBPlib Tournament", MakeTournament},
+  };
+  return registry;
+}
+
+std::unique_ptr<Predictor> MakePredictor(const json& description) {
+  std::string name = Name(description);
+  auto it = Registry().find(name);
+  if (it == Registry().end()) {
+    throw std::invalid_argument("MakePredictor: unknown predictor '" + name +
+                                "'");
+  }
+  return it->second(description);
+}
+
+void RegisterPredictor(const std::string& name, PredictorBuilder builder) {
+  Registry()[name] = std::move(builder);
+}
+
+std::vector<std::string> RegisteredPredictors() {
+  std::vector<std::string> names;
+  for (const auto& [name, builder] : Registry()) names.push_back(name);
+  return names;
+}
+
+}  // namespace mbp
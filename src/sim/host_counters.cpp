@@ -0,0 +1,167 @@
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mbp/sim/simulator.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+#ifdef __linux__
+
+namespace {
+
+/**
+ * Event of the host measured by HostCounters.
+ */
+struct HostEvent {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr uint64_t CacheEvent(uint64_t cache, uint64_t op, uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+constexpr HostEvent HOST_EVENTS[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"llc_misses", PERF_TYPE_HW_CACHE,
+     CacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE,
+     CacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/**
+ * Value of an event read with PERF_FORMAT_TOTAL_TIME_ENABLED
+ * and PERF_FORMAT_TOTAL_TIME_RUNNING.
+ */
+struct EventReading {
+  uint64_t value;
+  uint64_t timeEnabled;
+  uint64_t timeRunning;
+};
+
+}  // namespace
+
+detail::HostCounters::HostCounters(bool enabled) : enabled_(enabled) {
+  if (!enabled_) return;
+  for (const HostEvent& event : HOST_EVENTS) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = 1;
+    // Also count the threads of ParallelSim.
+    attr.inherit = 1;
+    // Allowed with the default perf_event_paranoid.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+      errors_.emplace_back(std::string(event.name) +
+                           ": perf_event_open failed: " + strerror(errno));
+    }
+    counters_.push_back({event.name, fd, 0});
+  }
+}
+
+detail::HostCounters::~HostCounters() {
+  for (const Counter& counter : counters_) {
+    if (counter.fd >= 0) close(counter.fd);
+  }
+}
+
+void detail::HostCounters::start() {
+  for (const Counter& counter : counters_) {
+    if (counter.fd < 0) continue;
+    ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void detail::HostCounters::stop() {
+  for (Counter& counter : counters_) {
+    if (counter.fd < 0) continue;
+    ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+    EventReading reading;
+    if (read(counter.fd, &reading, sizeof(reading)) != sizeof(reading)) {
+      errors_.emplace_back(std::string(counter.name) + ": read failed");
+      close(counter.fd);
+      counter.fd = -1;
+      continue;
+    }
+    // Scale the value if the event was multiplexed with others.
+    counter.value = reading.value;
+    if (reading.timeRunning != 0 && reading.timeRunning < reading.timeEnabled) {
+      counter.value = static_cast<double>(reading.value) *
+                      reading.timeEnabled / reading.timeRunning;
+    }
+  }
+}
+
+#else
+
+detail::HostCounters::HostCounters(bool enabled) : enabled_(enabled) {
+  if (enabled_) {
+    errors_.emplace_back("host counters are only supported on Linux");
+  }
+}
+
+detail::HostCounters::~HostCounters() {}
+
+void detail::HostCounters::start() {}
+
+void detail::HostCounters::stop() {}
+
+#endif
+
+json detail::HostCounters::report(int64_t simulatedInstr) const {
+  json counters = json::object();
+  json perKiloInstr = json::object();
+  const uint64_t* cycles = nullptr;
+  const uint64_t* instructions = nullptr;
+  for (const Counter& counter : counters_) {
+    if (counter.fd < 0) {
+      counters[counter.name] = nullptr;
+      continue;
+    }
+    counters[counter.name] = counter.value;
+    if (simulatedInstr > 0) {
+      perKiloInstr[counter.name] = 1000.0 * counter.value / simulatedInstr;
+    }
+    if (strcmp(counter.name, "cycles") == 0) cycles = &counter.value;
+    if (strcmp(counter.name, "instructions") == 0) {
+      instructions = &counter.value;
+    }
+  }
+  json j = {
+      {"counters", std::move(counters)},
+      {"per_kilo_instruction", std::move(perKiloInstr)},
+      {"errors", errors_},
+  };
+  if (cycles != nullptr && instructions != nullptr && *cycles != 0) {
+    j["ipc"] = static_cast<double>(*instructions) / *cycles;
+  } else {
+    j["ipc"] = nullptr;
+  }
+  return j;
+}
+
+}  // namespace mbp
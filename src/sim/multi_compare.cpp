@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mbp/sim/sbbt_reader.hpp"
+#include "mbp/sim/simulator.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+namespace {
+
+/**
+ * Per-branch statistics of the predictors of MultiCompare.
+ *
+ * The statistics of each branch are stored in a row of a flat array,
+ * with its occurrences followed by the mispredictions of each predictor,
+ * so that updating them after simulating a branch touches one cache line
+ * or a few consecutive ones.
+ */
+class BranchMatrix {
+ public:
+  BranchMatrix(size_t numPredictors, const SbbtReader& trace)
+      : rowSize_(numPredictors + 1), rowIdx_(trace) {}
+
+  /**
+   * Returns the row of a static branch, which is valid until the next call.
+   */
+  int64_t* row(const Branch& b) {
+    // Row indices are stored plus one, so that 0 means a new branch.
+    uint32_t& idx = rowIdx_[b];
+    if (idx == 0) {
+      counters_.resize(counters_.size() + rowSize_);
+      idx = counters_.size() / rowSize_;
+    }
+    return &counters_[(idx - 1) * rowSize_];
+  }
+
+  size_t numBranches() const { return counters_.size() / rowSize_; }
+
+  /**
+   * Returns the pairs of ip and row of every branch,
+   * given the ip of each static branch identifier.
+   */
+  std::vector<std::pair<uint64_t, const int64_t*>> rows(
+      const std::vector<uint64_t>& staticIps) const {
+    std::vector<std::pair<uint64_t, const int64_t*>> rows;
+    rows.reserve(numBranches());
+    rowIdx_.forEach(staticIps, [&](uint64_t ip, uint32_t idx) {
+      if (idx != 0) rows.emplace_back(ip, &counters_[(idx - 1) * rowSize_]);
+    });
+    return rows;
+  }
+
+ private:
+  size_t rowSize_;
+  detail::BranchTable<uint32_t> rowIdx_;
+  std::vector<int64_t> counters_;
+};
+
+}  // namespace
+
+/**
+ * Returns the difference between the largest and the smallest
+ * mispredictions of a row of a BranchMatrix.
+ */
+static int64_t MispredictionRange(const int64_t* row, size_t numPredictors) {
+  auto [min, max] = std::minmax_element(row + 1, row + 1 + numPredictors);
+  return *max - *min;
+}
+
+json MultiCompare(const std::vector<Predictor*>& predictors,
+                  const SimArgs& args) {
+  if (predictors.empty()) {
+    throw std::invalid_argument("MultiCompare: there are no predictors");
+  }
+  size_t n = predictors.size();
+  SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+  BranchMatrix matrix(n, trace);
+  std::vector<char> mispredicted(n);
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  bool exhaustedTrace = detail::ForEachBranch(
+      trace, args.stopAtInstr, [&](const Branch& b, int64_t instrNum) {
+        for (size_t i = 0; i < n; ++i) {
+          mispredicted[i] = detail::SimulateBranch(*predictors[i], b);
+        }
+        if (b.isConditional() && instrNum >= args.warmupInstrs) {
+          int64_t* row = matrix.row(b);
+          row[0] += 1;
+          for (size_t i = 0; i < n; ++i) row[i + 1] += mispredicted[i];
+        }
+      });
+  detail::TraceRun run = detail::EndTraceRun(trace, exhaustedTrace, startTime);
+  std::vector<std::string> errors;
+  int64_t metricInstr = detail::MetricInstr(args, run, errors);
+
+  auto rows = matrix.rows(run.staticIps);
+  int64_t numBranches = 0;
+  std::vector<int64_t> mispredictions(n);
+  // Sum over the branches of the absolute difference of mispredictions.
+  std::vector<std::vector<int64_t>> mispredictionsDiff(
+      n, std::vector<int64_t>(n));
+  int64_t rangeSum = 0;
+  for (const auto& [ip, row] : rows) {
+    numBranches += row[0];
+    for (size_t i = 0; i < n; ++i) {
+      mispredictions[i] += row[i + 1];
+      for (size_t j = i + 1; j < n; ++j) {
+        int64_t diff = std::abs(row[i + 1] - row[j + 1]);
+        mispredictionsDiff[i][j] += diff;
+        mispredictionsDiff[j][i] += diff;
+      }
+    }
+    rangeSum += MispredictionRange(row, n);
+  }
+  std::vector<double> mpki(n);
+  std::vector<std::vector<double>> mpkiDelta(n, std::vector<double>(n));
+  std::vector<std::vector<double>> mpkiDifference(n, std::vector<double>(n));
+  for (size_t i = 0; i < n; ++i) {
+    mpki[i] = 1000.0 * mispredictions[i] / metricInstr;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      mpkiDelta[i][j] = mpki[j] - mpki[i];
+      mpkiDifference[i][j] = 1000.0 * mispredictionsDiff[i][j] / metricInstr;
+    }
+  }
+
+  // The most separating branches are defined as those
+  // that together account for 1/2 of the sum of ranges of mispredictions.
+  std::sort(rows.begin(), rows.end(), [n](const auto& lhs, const auto& rhs) {
+    int64_t lhsRange = MispredictionRange(lhs.second, n);
+    int64_t rhsRange = MispredictionRange(rhs.second, n);
+    // Ties are broken by address, so that the order is deterministic.
+    if (lhsRange != rhsRange) return lhsRange > rhsRange;
+    return lhs.first < rhs.first;
+  });
+  std::vector<json> mostSeparatingJson;
+  size_t lastidx = std::min(rows.size(), detail::MAX_NUM_LISTED_BRANCHES);
+  for (int64_t keepsum = 0; mostSeparatingJson.size() < lastidx;) {
+    if (2 * keepsum >= rangeSum) break;
+    const auto& [ip, row] = rows[mostSeparatingJson.size()];
+    const int64_t* misses = row + 1;
+    int64_t range = MispredictionRange(row, n);
+    keepsum += range;
+    std::vector<double> branchMpki(n);
+    for (size_t i = 0; i < n; ++i) {
+      branchMpki[i] = 1000.0 * misses[i] / metricInstr;
+    }
+    json j{
+        {"ip", ip},
+        {"occurrences", row[0]},
+        {"mpki", branchMpki},
+        {"mpki_range", 1000.0 * range / metricInstr},
+        {"best_predictor", std::min_element(misses, misses + n) - misses},
+        {"worst_predictor", std::max_element(misses, misses + n) - misses},
+    };
+    mostSeparatingJson.emplace_back(std::move(j));
+  }
+
+  std::vector<json> metadata, executionStats;
+  for (const Predictor* p : predictors) {
+    metadata.emplace_back(p->metadata_stats());
+    executionStats.emplace_back(p->execution_stats());
+  }
+  json j = {
+      {"metadata",
+       {
+           {"simulator", "MBPlib multi compare"},
+           {"simulator_version", "v0.1.0"},
+           {"trace", args.tracepath},
+           {"warmup_instr", args.warmupInstrs},
+           {"simulation_instr", metricInstr},
+           {"exhausted_trace", run.exhaustedTrace},
+           {"num_conditonal_branches", numBranches},
+           {"num_branch_instructions", matrix.numBranches()},
+           {"predictors", std::move(metadata)},
+       }},
+      {"metrics",
+       {
+           {"mpki", mpki},
+           {"mispredictions", mispredictions},
+           {"mpki_delta", mpkiDelta},
+           {"mpki_difference", mpkiDifference},
+           {"simulation_time", run.simulationTime},
+           {"num_most_separating_branches", mostSeparatingJson.size()},
+       }},
+      {"predictor_statistics", std::move(executionStats)},
+      {"most_separating", mostSeparatingJson},
+      {"errors", errors},
+  };
+  return j;
+}
+
+int MultiCompareMain(int argc, char** argv,
+                     const std::vector<Predictor*>& predictors) {
+  SimArgs args = ParseCmdLineArgs(argc, argv);
+  return detail::PrintReport(MultiCompare(predictors, args), args);
+}
+
+}  // namespace mbp
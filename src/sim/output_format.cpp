@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "mbp/sim/simulator.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+/**
+ * Returns whether a value of an output is written as a sequence of records,
+ * i.e., whether it is a non-empty array of objects.
+ */
+static bool IsRecordArray(const json& value) {
+  return value.is_array() && !value.empty() &&
+         std::all_of(value.begin(), value.end(),
+                     [](const json& element) { return element.is_object(); });
+}
+
+void WriteRecord(std::ostream& os, const std::string& kind,
+                 const json& fields, OutputFormat format) {
+  if (fields.contains("record")) {
+    throw std::invalid_argument("WriteRecord: a record of kind '" + kind +
+                                "' cannot have a field \"record\"");
+  }
+  json record = {{"record", kind}};
+  for (const auto& field : fields.items()) {
+    record[field.key()] = field.value();
+  }
+  switch (format) {
+    case OutputFormat::JSON:
+    case OutputFormat::NDJSON:
+      os << record.dump() << '\n';
+      break;
+    case OutputFormat::CBOR:
+      json::to_cbor(record, os);
+      break;
+    case OutputFormat::MSGPACK:
+      json::to_msgpack(record, os);
+      break;
+  }
+}
+
+void WriteReport(std::ostream& os, const json& output, OutputFormat format) {
+  if (format == OutputFormat::JSON) {
+    os << std::setw(2) << output << '\n';
+    return;
+  }
+  // The records are written as they are found,
+  // and the rest of the output is gathered in the summary.
+  json summary = json::object();
+  for (const auto& item : output.items()) {
+    if (IsRecordArray(item.value())) {
+      for (const json& element : item.value()) {
+        WriteRecord(os, item.key(), element, format);
+      }
+    } else {
+      summary[item.key()] = item.value();
+    }
+  }
+  WriteRecord(os, "summary", summary, format);
+}
+
+bool detail::ParseOutputFormat(const std::string& name, OutputFormat& format) {
+  if (name == "json") {
+    format = OutputFormat::JSON;
+  } else if (name == "ndjson") {
+    format = OutputFormat::NDJSON;
+  } else if (name == "cbor") {
+    format = OutputFormat::CBOR;
+  } else if (name == "msgpack") {
+    format = OutputFormat::MSGPACK;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace mbp
@@ -0,0 +1,197 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include "mbp/sim/ip_table.hpp"
+#include "mbp/sim/sbbt_columnar.hpp"
+#include "mbp/sim/sbbt_reader.hpp"
+#include "sbbt_decode.hpp"
+
+namespace mbp {
+
+namespace {
+
+// Number of branches decoded at a time.
+constexpr size_t BATCH_BRANCHES = 1 << 16;
+
+uint64_t AlignUp(uint64_t offset) {
+  return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+}
+
+/**
+ * Temporary file mapped into memory,
+ * which is removed unless it is committed.
+ */
+class MappedTmpFile {
+ public:
+  MappedTmpFile(const std::string& path, size_t size)
+      : path_(path), size_(size), data_(nullptr) {
+    int fd = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      throw std::system_error(errno, std::generic_category(),
+                              "open of '" + path_ + "' failed");
+    }
+    void* addr = MAP_FAILED;
+    if (ftruncate(fd, size_) == 0) {
+      addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      unlink(path_.c_str());
+      throw std::system_error(error, std::generic_category(),
+                              "mapping of '" + path_ + "' failed");
+    }
+    data_ = static_cast<char*>(addr);
+  }
+
+  ~MappedTmpFile() {
+    if (data_ == nullptr) return;
+    munmap(data_, size_);
+    unlink(path_.c_str());
+  }
+
+  char* data() { return data_; }
+
+  /**
+   * Writes the first size bytes of the file to the disk,
+   * discarding the rest, and renames it.
+   */
+  void commit(const std::string& path, size_t size) {
+    if (msync(data_, size, MS_SYNC) == -1) {
+      throw std::system_error(errno, std::generic_category(), "msync failed");
+    }
+    munmap(data_, size_);
+    data_ = nullptr;
+    if (truncate(path_.c_str(), size) == -1) {
+      int error = errno;
+      unlink(path_.c_str());
+      throw std::system_error(error, std::generic_category(),
+                              "truncate of '" + path_ + "' failed");
+    }
+    if (rename(path_.c_str(), path.c_str()) == -1) {
+      int error = errno;
+      unlink(path_.c_str());
+      throw std::system_error(error, std::generic_category(),
+                              "rename to '" + path + "' failed");
+    }
+  }
+
+ private:
+  std::string path_;
+  size_t size_;
+  char* data_;
+};
+
+}  // namespace
+
+void MakeColumnarTrace(const std::string& input, const std::string& output,
+                       uint64_t checkpointBranches) {
+  if (checkpointBranches == 0) {
+    throw std::invalid_argument(
+        "MakeColumnarTrace: checkpointBranches must be positive");
+  }
+  const std::string extension = ".sbbtc";
+  if (output.size() <= extension.size() ||
+      output.compare(output.size() - extension.size(), extension.size(),
+                     extension) != 0) {
+    throw std::invalid_argument("MakeColumnarTrace: output '" + output +
+                                "' must have extension .sbbtc");
+  }
+  if (input == output) {
+    throw std::invalid_argument(
+        "MakeColumnarTrace: a trace cannot be rewritten in place");
+  }
+
+  SbbtReader reader(input);
+  uint64_t n = reader.numBranches();
+  uint64_t numCheckpoints = (n + checkpointBranches - 1) / checkpointBranches;
+  SbbtColumnarHeader header{};
+  header.mark = SBBT_COLUMNAR_MARK;
+  header.numInstructions = reader.numInstructions();
+  header.numBranches = n;
+  header.checkpointBranches = checkpointBranches;
+  header.ipOffset = AlignUp(sizeof(SbbtColumnarHeader));
+  header.targetOffset = AlignUp(header.ipOffset + n * sizeof(uint64_t));
+  header.flagsOffset = AlignUp(header.targetOffset + n * sizeof(uint64_t));
+  header.ninstrOffset = AlignUp(header.flagsOffset + n * sizeof(uint8_t));
+  header.staticIdOffset = AlignUp(header.ninstrOffset + n * sizeof(uint16_t));
+  header.checkpointsOffset =
+      AlignUp(header.staticIdOffset + n * sizeof(uint32_t));
+  header.staticIpsOffset =
+      AlignUp(header.checkpointsOffset + numCheckpoints * sizeof(int64_t));
+  // The number of static branches is only known after reading the trace,
+  // so the file is truncated afterwards to the ips of those read.
+  uint64_t maxStaticIds = std::max<uint64_t>(n, reader.numStaticIds());
+  uint64_t maxSize = header.staticIpsOffset + maxStaticIds * sizeof(uint64_t);
+
+  MappedTmpFile image(output + ".tmp", maxSize);
+  char* base = image.data();
+  auto ip = reinterpret_cast<uint64_t*>(base + header.ipOffset);
+  auto target = reinterpret_cast<uint64_t*>(base + header.targetOffset);
+  auto flags = reinterpret_cast<uint8_t*>(base + header.flagsOffset);
+  auto ninstr = reinterpret_cast<uint16_t*>(base + header.ninstrOffset);
+  auto staticId = reinterpret_cast<uint32_t*>(base + header.staticIdOffset);
+  auto checkpoints =
+      reinterpret_cast<int64_t*>(base + header.checkpointsOffset);
+
+  // The ips, targets and static branch identifiers
+  // are decoded directly into their columns.
+  // Traces that do not store the identifiers are numbered here,
+  // in order of appearance, so that reading the image does not need to.
+  bool numberBranches = !reader.storesStaticIds();
+  std::vector<uint64_t> staticIps = reader.staticIps();
+  // Identifier of each address plus one, so that 0 means a new address.
+  IpTable<uint32_t> staticIds;
+  std::vector<uint8_t> opcode(BATCH_BRANCHES);
+  std::vector<uint8_t> outcome(BATCH_BRANCHES);
+  std::vector<int64_t> instrNum(BATCH_BRANCHES);
+  uint64_t read = 0;
+  int64_t instrCtr = 0;
+  while (read < n) {
+    BranchArrays batch = {ip + read, target + read, opcode.data(),
+                          outcome.data(), instrNum.data(), staticId + read};
+    size_t len = reader.nextBranches(
+        batch, std::min<uint64_t>(BATCH_BRANCHES, n - read));
+    if (len == 0) break;
+    for (size_t i = 0; i < len; ++i, ++read) {
+      if (numberBranches) {
+        uint32_t& id = staticIds[ip[read]];
+        if (id == 0) {
+          staticIps.push_back(ip[read]);
+          id = staticIps.size();
+        }
+        staticId[read] = id - 1;
+      }
+      if (read % checkpointBranches == 0) {
+        checkpoints[read / checkpointBranches] = instrCtr;
+      }
+      flags[read] = opcode[i] | outcome[i] << COLUMN_OUTCOME_SHIFT;
+      // The deltas of the SBBT format have 12 bits.
+      ninstr[read] = instrNum[i] - instrCtr;
+      instrCtr = instrNum[i];
+    }
+  }
+  if (read != n || !reader.eof()) {
+    throw std::invalid_argument("MakeColumnarTrace: trace '" + input +
+                                "' does not have the number of branches "
+                                "of its header");
+  }
+  header.numStaticIds = staticIps.size();
+  header.size =
+      header.staticIpsOffset + header.numStaticIds * sizeof(uint64_t);
+  memcpy(base + header.staticIpsOffset, staticIps.data(),
+         header.numStaticIds * sizeof(uint64_t));
+  memcpy(base, &header, sizeof(header));
+  image.commit(output, header.size);
+}
+
+}  // namespace mbp
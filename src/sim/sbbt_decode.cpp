@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "sbbt_decode.hpp"
+
+#ifdef MBPLIB_X86_64
+#include <immintrin.h>
+#endif
+
+namespace mbp {
+
+int64_t DecodeSbbtBranchesScalar(const char* src, size_t n, int64_t instrCtr,
+                                 const BranchArrays& out) {
+  const SbbtBranch* srcBranch = reinterpret_cast<const SbbtBranch*>(src);
+  for (size_t i = 0; i < n; ++i) {
+    instrCtr += srcBranch[i].ninstr;
+    out.ip[i] = sign_extend_ip(srcBranch[i].ip);
+    out.target[i] = sign_extend_ip(srcBranch[i].target);
+    out.opcode[i] = srcBranch[i].opcode;
+    out.outcome[i] = srcBranch[i].outcome;
+    out.instrNum[i] = instrCtr;
+  }
+  return instrCtr;
+}
+
+#ifdef MBPLIB_X86_64
+
+/**
+ * Returns the arrays of out starting at index i.
+ */
+static BranchArrays Offset(const BranchArrays& out, size_t i) {
+  return {out.ip + i,
+          out.target + i,
+          out.opcode + i,
+          out.outcome + i,
+          out.instrNum + i,
+          out.staticId == nullptr ? nullptr : out.staticId + i};
+}
+
+// In a record, the first word contains the opcode in bits [0, 4),
+// the outcome in bit 11 and the ip in bits [12, 64),
+// and the second word contains the instruction delta in bits [0, 12)
+// and the target in bits [12, 64).
+// Hence, the sign extension of the ip (and the target)
+// is an arithmetic right shift of its word by 12 bits.
+
+__attribute__((target("avx2"))) int64_t DecodeSbbtBranchesAvx2(
+    const char* src, size_t n, int64_t instrCtr, const BranchArrays& out) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lastBit = _mm256_set1_epi64x(int64_t{1} << 51);
+  const __m256i opcodeMask = _mm256_set1_epi64x(0xF);
+  const __m256i ninstrMask = _mm256_set1_epi64x(0xFFF);
+  const __m256i one = _mm256_set1_epi64x(1);
+  // Gathers, in each 128-bit lane, the opcodes and then the outcomes
+  // of its two records in the lowest 4 bytes.
+  const __m256i flagsShuffle = _mm256_setr_epi8(
+      0, 8, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  //
+      0, 8, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  __m256i base = _mm256_set1_epi64x(instrCtr);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // Records i and i+1, and records i+2 and i+3.
+    __m256i r01 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + i * sizeof(SbbtBranch)));
+    __m256i r23 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + (i + 2) * sizeof(SbbtBranch)));
+    // Separate the first and second words of the 4 records.
+    __m256i w0 = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(r01, r23),
+                                          _MM_SHUFFLE(3, 1, 2, 0));
+    __m256i w1 = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(r01, r23),
+                                          _MM_SHUFFLE(3, 1, 2, 0));
+    // AVX2 lacks 64-bit arithmetic shifts, so use sign_extend_ip's trick.
+    __m256i ip = _mm256_sub_epi64(
+        _mm256_xor_si256(_mm256_srli_epi64(w0, 12), lastBit), lastBit);
+    __m256i target = _mm256_sub_epi64(
+        _mm256_xor_si256(_mm256_srli_epi64(w1, 12), lastBit), lastBit);
+    // Inclusive prefix sum of the instruction deltas.
+    __m256i instr = _mm256_and_si256(w1, ninstrMask);
+    instr = _mm256_add_epi64(
+        instr, _mm256_blend_epi32(
+                   _mm256_permute4x64_epi64(instr, _MM_SHUFFLE(2, 1, 0, 0)),
+                   zero, 0x03));
+    instr = _mm256_add_epi64(
+        instr, _mm256_blend_epi32(
+                   _mm256_permute4x64_epi64(instr, _MM_SHUFFLE(1, 0, 0, 0)),
+                   zero, 0x0F));
+    instr = _mm256_add_epi64(instr, base);
+    base = _mm256_permute4x64_epi64(instr, _MM_SHUFFLE(3, 3, 3, 3));
+    // Each word gets the opcode in byte 0 and the outcome in byte 1.
+    __m256i flags = _mm256_or_si256(
+        _mm256_and_si256(w0, opcodeMask),
+        _mm256_slli_epi64(_mm256_and_si256(_mm256_srli_epi64(w0, 11), one), 8));
+    flags = _mm256_shuffle_epi8(flags, flagsShuffle);
+    uint32_t lo = _mm256_extract_epi32(flags, 0);
+    uint32_t hi = _mm256_extract_epi32(flags, 4);
+    uint32_t opcodes = (lo & 0xFFFF) | (hi << 16);
+    uint32_t outcomes = (lo >> 16) | (hi & 0xFFFF0000);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.ip + i), ip);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.target + i), target);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.instrNum + i), instr);
+    memcpy(out.opcode + i, &opcodes, sizeof(opcodes));
+    memcpy(out.outcome + i, &outcomes, sizeof(outcomes));
+  }
+  if (i != 0) instrCtr = _mm256_extract_epi64(base, 0);
+  return DecodeSbbtBranchesScalar(src + i * sizeof(SbbtBranch), n - i,
+                                  instrCtr, Offset(out, i));
+}
+
+__attribute__((target("avx512f"))) int64_t DecodeSbbtBranchesAvx512(
+    const char* src, size_t n, int64_t instrCtr, const BranchArrays& out) {
+  const __m512i firstWords = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+  const __m512i secondWords = _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15);
+  const __m512i shift1 = _mm512_setr_epi64(0, 0, 1, 2, 3, 4, 5, 6);
+  const __m512i shift2 = _mm512_setr_epi64(0, 0, 0, 1, 2, 3, 4, 5);
+  const __m512i shift4 = _mm512_setr_epi64(0, 0, 0, 0, 0, 1, 2, 3);
+  const __m512i lastLane = _mm512_set1_epi64(7);
+  const __m512i opcodeMask = _mm512_set1_epi64(0xF);
+  const __m512i ninstrMask = _mm512_set1_epi64(0xFFF);
+  const __m512i one = _mm512_set1_epi64(1);
+  __m512i base = _mm512_set1_epi64(instrCtr);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i r0 = _mm512_loadu_si512(src + i * sizeof(SbbtBranch));
+    __m512i r1 = _mm512_loadu_si512(src + (i + 4) * sizeof(SbbtBranch));
+    __m512i w0 = _mm512_permutex2var_epi64(r0, firstWords, r1);
+    __m512i w1 = _mm512_permutex2var_epi64(r0, secondWords, r1);
+    __m512i ip = _mm512_srai_epi64(w0, 12);
+    __m512i target = _mm512_srai_epi64(w1, 12);
+    // Inclusive prefix sum of the instruction deltas.
+    __m512i instr = _mm512_and_si512(w1, ninstrMask);
+    instr = _mm512_add_epi64(
+        instr, _mm512_maskz_permutexvar_epi64(0xFE, shift1, instr));
+    instr = _mm512_add_epi64(
+        instr, _mm512_maskz_permutexvar_epi64(0xFC, shift2, instr));
+    instr = _mm512_add_epi64(
+        instr, _mm512_maskz_permutexvar_epi64(0xF0, shift4, instr));
+    instr = _mm512_add_epi64(instr, base);
+    base = _mm512_permutexvar_epi64(lastLane, instr);
+    __m128i opcodes = _mm512_cvtepi64_epi8(_mm512_and_si512(w0, opcodeMask));
+    __m128i outcomes =
+        _mm512_cvtepi64_epi8(_mm512_and_si512(_mm512_srli_epi64(w0, 11), one));
+
+    _mm512_storeu_si512(out.ip + i, ip);
+    _mm512_storeu_si512(out.target + i, target);
+    _mm512_storeu_si512(out.instrNum + i, instr);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out.opcode + i), opcodes);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out.outcome + i), outcomes);
+  }
+  if (i != 0) instrCtr = _mm_cvtsi128_si64(_mm512_castsi512_si128(base));
+  return DecodeSbbtBranchesScalar(src + i * sizeof(SbbtBranch), n - i,
+                                  instrCtr, Offset(out, i));
+}
+
+#endif  // MBPLIB_X86_64
+
+using DecodeFunction = int64_t (*)(const char*, size_t, int64_t,
+                                   const BranchArrays&);
+
+static DecodeFunction SelectDecodeFunction() {
+#ifdef MBPLIB_X86_64
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return DecodeSbbtBranchesAvx512;
+  if (__builtin_cpu_supports("avx2")) return DecodeSbbtBranchesAvx2;
+#endif
+  return DecodeSbbtBranchesScalar;
+}
+
+int64_t DecodeSbbtBranches(const char* src, size_t n, int64_t instrCtr,
+                           const BranchArrays& out) {
+  static const DecodeFunction decode = SelectDecodeFunction();
+  return decode(src, n, instrCtr, out);
+}
+
+int64_t DecodeSbbtV2BranchesScalar(const char* src, size_t n,
+                                   int64_t instrCtr,
+                                   const SbbtDictionary& dictionary,
+                                   const BranchArrays& out) {
+  const SbbtBranchV2* srcBranch = reinterpret_cast<const SbbtBranchV2*>(src);
+  // The entries have the layout of v1 records,
+  // so the sign extension of the ip and target is an arithmetic shift.
+  const int64_t* words =
+      reinterpret_cast<const int64_t*>(dictionary.words.data());
+  for (size_t i = 0; i < n; ++i) {
+    const int64_t* entry = words + 2 * srcBranch[i].entry;
+    instrCtr += srcBranch[i].ninstr;
+    out.ip[i] = entry[0] >> 12;
+    out.target[i] = entry[1] >> 12;
+    out.opcode[i] = entry[0] & 0xF;
+    out.outcome[i] = srcBranch[i].outcome;
+    out.instrNum[i] = instrCtr;
+  }
+  if (out.staticId != nullptr) {
+    for (size_t i = 0; i < n; ++i) {
+      out.staticId[i] = dictionary.staticIds[srcBranch[i].entry];
+    }
+  }
+  return instrCtr;
+}
+
+#ifdef MBPLIB_X86_64
+
+// A v2 record contains the entry in bits [0, 32),
+// the instruction delta in bits [32, 48) and the outcome in bits [48, 56).
+
+__attribute__((target("avx512f"))) int64_t DecodeSbbtV2BranchesAvx512(
+    const char* src, size_t n, int64_t instrCtr,
+    const SbbtDictionary& dictionary, const BranchArrays& out) {
+  const long long* words =
+      reinterpret_cast<const long long*>(dictionary.words.data());
+  const int* staticIds =
+      reinterpret_cast<const int*>(dictionary.staticIds.data());
+  const __m512i shift1 = _mm512_setr_epi64(0, 0, 1, 2, 3, 4, 5, 6);
+  const __m512i shift2 = _mm512_setr_epi64(0, 0, 0, 1, 2, 3, 4, 5);
+  const __m512i shift4 = _mm512_setr_epi64(0, 0, 0, 0, 0, 1, 2, 3);
+  const __m512i lastLane = _mm512_set1_epi64(7);
+  const __m512i entryMask = _mm512_set1_epi64(0xFFFFFFFF);
+  const __m512i opcodeMask = _mm512_set1_epi64(0xF);
+  const __m512i ninstrMask = _mm512_set1_epi64(0xFFFF);
+  __m512i base = _mm512_set1_epi64(instrCtr);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i r = _mm512_loadu_si512(src + i * sizeof(SbbtBranchV2));
+    // Index of the first word of each entry.
+    __m512i word = _mm512_slli_epi64(_mm512_and_si512(r, entryMask), 1);
+    __m512i w0 = _mm512_i64gather_epi64(word, words, 8);
+    __m512i w1 = _mm512_i64gather_epi64(word, words + 1, 8);
+    __m512i ip = _mm512_srai_epi64(w0, 12);
+    __m512i target = _mm512_srai_epi64(w1, 12);
+    // Inclusive prefix sum of the instruction deltas.
+    __m512i instr = _mm512_and_si512(_mm512_srli_epi64(r, 32), ninstrMask);
+    instr = _mm512_add_epi64(
+        instr, _mm512_maskz_permutexvar_epi64(0xFE, shift1, instr));
+    instr = _mm512_add_epi64(
+        instr, _mm512_maskz_permutexvar_epi64(0xFC, shift2, instr));
+    instr = _mm512_add_epi64(
+        instr, _mm512_maskz_permutexvar_epi64(0xF0, shift4, instr));
+    instr = _mm512_add_epi64(instr, base);
+    base = _mm512_permutexvar_epi64(lastLane, instr);
+    __m128i opcodes = _mm512_cvtepi64_epi8(_mm512_and_si512(w0, opcodeMask));
+    __m128i outcomes = _mm512_cvtepi64_epi8(_mm512_srli_epi64(r, 48));
+
+    _mm512_storeu_si512(out.ip + i, ip);
+    _mm512_storeu_si512(out.target + i, target);
+    _mm512_storeu_si512(out.instrNum + i, instr);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out.opcode + i), opcodes);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out.outcome + i), outcomes);
+    if (out.staticId != nullptr) {
+      __m256i ids = _mm512_i64gather_epi32(
+          _mm512_and_si512(r, entryMask), staticIds, 4);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.staticId + i), ids);
+    }
+  }
+  if (i != 0) instrCtr = _mm_cvtsi128_si64(_mm512_castsi512_si128(base));
+  return DecodeSbbtV2BranchesScalar(src + i * sizeof(SbbtBranchV2), n - i,
+                                    instrCtr, dictionary, Offset(out, i));
+}
+
+#endif  // MBPLIB_X86_64
+
+using DecodeV2Function = int64_t (*)(const char*, size_t, int64_t,
+                                     const SbbtDictionary&,
+                                     const BranchArrays&);
+
+static DecodeV2Function SelectDecodeV2Function() {
+#ifdef MBPLIB_X86_64
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return DecodeSbbtV2BranchesAvx512;
+#endif
+  return DecodeSbbtV2BranchesScalar;
+}
+
+int64_t DecodeSbbtV2Branches(const char* src, size_t n, int64_t instrCtr,
+                             const SbbtDictionary& dictionary,
+                             const BranchArrays& out) {
+  static const DecodeV2Function decode = SelectDecodeV2Function();
+  // The entries are checked before decoding,
+  // so that the decoding loops have no branches.
+  const SbbtBranchV2* srcBranch = reinterpret_cast<const SbbtBranchV2*>(src);
+  uint32_t maxEntry = 0;
+  for (size_t i = 0; i < n; ++i) {
+    maxEntry = std::max(maxEntry, srcBranch[i].entry);
+  }
+  if (n != 0 && maxEntry >= dictionary.size()) {
+    throw std::invalid_argument("SbbtReader: a branch refers to entry " +
+                                std::to_string(maxEntry) +
+                                " of a dictionary of " +
+                                std::to_string(dictionary.size()) +
+                                " entries.");
+  }
+  return decode(src, n, instrCtr, dictionary, out);
+}
+
+}  // namespace mbp
@@ -0,0 +1,162 @@
+#ifndef MBP_SBBT_DECODE_HPP_
+#define MBP_SBBT_DECODE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mbp/sim/sbbt_reader.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MBPLIB_X86_64
+#endif
+
+namespace mbp {
+
+/**
+ * Branch record of the SBBT format v1.
+ */
+struct SbbtBranch {
+  unsigned opcode : 4;
+  unsigned padding : 7;
+  unsigned outcome : 1;
+  unsigned long long ip : 52;
+  unsigned ninstr : 12;
+  unsigned long long target : 52;
+};
+static_assert(sizeof(SbbtBranch) == 16);
+
+/**
+ * Branch record of the SBBT format v2.
+ *
+ * The ip, target and opcode of the branch are those of an entry
+ * of the dictionary of the trace, which follows the header
+ * as the number of entries (8 bytes) and the entries,
+ * stored as v1 records with ninstr and outcome set to 0.
+ * Hence, branches with several targets have one entry per target.
+ */
+struct SbbtBranchV2 {
+  uint32_t entry;
+  uint16_t ninstr;
+  uint8_t outcome;
+  uint8_t padding;
+};
+static_assert(sizeof(SbbtBranchV2) == 8);
+
+/**
+ * Dictionary of an SBBT v2 trace.
+ *
+ * The entries are kept as stored, two words per entry,
+ * so that each branch only loads 16 contiguous bytes.
+ */
+struct SbbtDictionary {
+  std::vector<uint64_t> words;
+  // Static branch identifier of the ip of each entry.
+  std::vector<uint32_t> staticIds;
+
+  size_t size() const { return words.size() / 2; }
+};
+
+/**
+ * Returns the instruction delta of the record of an SBBT trace at src.
+ */
+inline unsigned SbbtRecordNinstr(const char* src, unsigned version) {
+  if (version == 1) return reinterpret_cast<const SbbtBranch*>(src)->ninstr;
+  return reinterpret_cast<const SbbtBranchV2*>(src)->ninstr;
+}
+
+/**
+ * Header of a columnar trace (see MakeColumnarTrace).
+ *
+ * It is followed by the columns, each one aligned to COLUMN_ALIGNMENT bytes:
+ * the ip, target, flags (opcode | outcome << 7), instruction delta
+ * and static branch identifier of every branch, the checkpoints,
+ * which are the instruction numbers of the branches before the branches
+ * 0, checkpointBranches, 2 * checkpointBranches...,
+ * and the ip of each static branch identifier.
+ */
+struct SbbtColumnarHeader {
+  uint64_t mark;
+  uint64_t numInstructions;
+  uint64_t numBranches;
+  uint64_t checkpointBranches;
+  uint64_t numStaticIds;
+  // Offsets of the columns in the file.
+  uint64_t ipOffset;
+  uint64_t targetOffset;
+  uint64_t flagsOffset;
+  uint64_t ninstrOffset;
+  uint64_t staticIdOffset;
+  uint64_t checkpointsOffset;
+  uint64_t staticIpsOffset;
+  // Size of the file.
+  uint64_t size;
+};
+static_assert(sizeof(SbbtColumnarHeader) == 104);
+
+// "SBBC\n" followed by the version of the columnar format (2).
+constexpr uint64_t SBBT_COLUMNAR_MARK = 0x0000020A43424253ULL;
+// Alignment of the columns, enough for any vector load.
+constexpr uint64_t COLUMN_ALIGNMENT = 64;
+// Bit of the outcome in the flags column.
+constexpr unsigned COLUMN_OUTCOME_SHIFT = 7;
+
+constexpr uint64_t sign_extend_ip(uint64_t ip) {
+  constexpr uint64_t lastBit = uint64_t{1} << 51;
+  // If (ip & lastBit) == 0, then ip is unchanged,
+  // otherwise lastBit and the following bits get set to 1.
+  return (ip ^ lastBit) - lastBit;
+}
+
+/**
+ * Decodes n consecutive SBBT branch records into arrays.
+ *
+ * The instruction numbers are the prefix sum of the instruction deltas
+ * of the records, starting at instrCtr.
+ * The implementation is chosen at runtime
+ * among the ones supported by the processor.
+ *
+ * @return the instruction number of the last branch decoded.
+ */
+int64_t DecodeSbbtBranches(const char* src, size_t n, int64_t instrCtr,
+                           const BranchArrays& out);
+
+/**
+ * Decodes n consecutive SBBT v2 branch records into arrays.
+ *
+ * Like DecodeSbbtBranches(), but looking up the ip, target and opcode
+ * of each branch in the dictionary of the trace.
+ * Throws if a record refers to an entry out of the dictionary.
+ *
+ * @return the instruction number of the last branch decoded.
+ */
+int64_t DecodeSbbtV2Branches(const char* src, size_t n, int64_t instrCtr,
+                             const SbbtDictionary& dictionary,
+                             const BranchArrays& out);
+
+// Implementations of DecodeSbbtBranches.
+// The vectorized ones must only be called if the processor supports them.
+int64_t DecodeSbbtBranchesScalar(const char* src, size_t n, int64_t instrCtr,
+                                 const BranchArrays& out);
+#ifdef MBPLIB_X86_64
+int64_t DecodeSbbtBranchesAvx2(const char* src, size_t n, int64_t instrCtr,
+                               const BranchArrays& out);
+int64_t DecodeSbbtBranchesAvx512(const char* src, size_t n, int64_t instrCtr,
+                                 const BranchArrays& out);
+#endif
+
+// Implementations of DecodeSbbtV2Branches, which do not check the entries.
+int64_t DecodeSbbtV2BranchesScalar(const char* src, size_t n,
+                                   int64_t instrCtr,
+                                   const SbbtDictionary& dictionary,
+                                   const BranchArrays& out);
+#ifdef MBPLIB_X86_64
+int64_t DecodeSbbtV2BranchesAvx512(const char* src, size_t n,
+                                   int64_t instrCtr,
+                                   const SbbtDictionary& dictionary,
+                                   const BranchArrays& out);
+#endif
+
+}  // namespace mbp
+
+#endif  // MBP_SBBT_DECODE_HPP_
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#ifdef MBPLIB_HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "mbp/sim/sbbt_index.hpp"
+#include "mbp/sim/sbbt_reader.hpp"
+#include "sbbt_decode.hpp"
+#include "trace_source.hpp"
+
+namespace mbp {
+
+namespace {
+
+// "SBIX\n" followed by the version of the index format (1).
+constexpr uint64_t INDEX_MARK = 0x0000010A58494253ULL;
+// Size of the header of an SBBT trace.
+constexpr uint64_t SBBT_HEADER_SIZE = 24;
+
+struct IndexHeader {
+  uint64_t mark;
+  uint64_t numInstructions;
+  uint64_t numBranches;
+  uint64_t numEntries;
+};
+
+bool EndsWith(const std::string& str, const std::string& suffix) {
+  return str.size() > suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+FILE* OpenFile(const std::string& path, const char* mode) {
+  FILE* file = fopen(path.c_str(), mode);
+  if (file == nullptr) {
+    throw std::system_error(errno, std::generic_category(),
+                            "fopen of '" + path + "' failed");
+  }
+  return file;
+}
+
+void Write(FILE* file, const void* data, size_t size) {
+  if (std::fwrite(data, sizeof(char), size, file) != size) {
+    throw std::runtime_error(std::strerror(errno));
+  }
+}
+
+/**
+ * Reads from source until n bytes are read or the source is exhausted.
+ */
+size_t ReadFully(TraceSource& source, char* dst, size_t n) {
+  size_t len = 0;
+  while (len < n && !source.eof()) len += source.read(dst + len, n - len);
+  return len;
+}
+
+/**
+ * Returns whether two paths name the same file.
+ */
+bool SameFile(const std::string& lhs, const std::string& rhs) {
+  std::error_code ec;
+  return std::filesystem::equivalent(lhs, rhs, ec);
+}
+
+/**
+ * Writer of the chunks of a seekable trace.
+ *
+ * The chunks are written to a temporary file,
+ * which only replaces the output when it is closed,
+ * so the input is never lost, even if it is the output.
+ */
+class ChunkWriter {
+ public:
+  ChunkWriter(const std::string& output, bool compress, int level)
+      : output_(output),
+        tmpPath_(output + ".tmp"),
+        file_(OpenFile(tmpPath_, "w")),
+        offset_(0),
+        compress_(compress) {
+    if (!compress_) return;
+#ifdef MBPLIB_HAVE_LIBZSTD
+    cctx_ = ZSTD_createCCtx();
+    if (cctx_ == nullptr) {
+      fclose(file_);
+      std::remove(tmpPath_.c_str());
+      throw std::runtime_error("MakeSeekableTrace: ZSTD_createCCtx failed");
+    }
+    ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level);
+#endif
+  }
+
+  ~ChunkWriter() {
+#ifdef MBPLIB_HAVE_LIBZSTD
+    ZSTD_freeCCtx(cctx_);
+#endif
+    if (file_ == nullptr) return;
+    fclose(file_);
+    std::remove(tmpPath_.c_str());
+  }
+
+  /**
+   * Writes data as a chunk that can be decoded independently.
+   */
+  void write(const char* data, size_t size) {
+    if (!compress_) {
+      Write(file_, data, size);
+      offset_ += size;
+      return;
+    }
+#ifdef MBPLIB_HAVE_LIBZSTD
+    frame_.resize(ZSTD_compressBound(size));
+    size_t len =
+        ZSTD_compress2(cctx_, frame_.data(), frame_.size(), data, size);
+    if (ZSTD_isError(len)) {
+      throw std::runtime_error(std::string("MakeSeekableTrace: zstd error: ") +
+                               ZSTD_getErrorName(len));
+    }
+    Write(file_, frame_.data(), len);
+    offset_ += len;
+#endif
+  }
+
+  /**
+   * Closes the temporary file and renames it to the output.
+   */
+  void close() {
+    int ret = fclose(file_);
+    file_ = nullptr;
+    if (ret != 0) {
+      int error = errno;
+      std::remove(tmpPath_.c_str());
+      throw std::system_error(error, std::generic_category(),
+                              "fclose of '" + tmpPath_ + "' failed");
+    }
+    if (std::rename(tmpPath_.c_str(), output_.c_str()) != 0) {
+      int error = errno;
+      std::remove(tmpPath_.c_str());
+      throw std::system_error(error, std::generic_category(),
+                              "rename to '" + output_ + "' failed");
+    }
+  }
+
+  /**
+   * Returns the offset in the output file of the next chunk.
+   */
+  uint64_t offset() const { return offset_; }
+
+ private:
+  std::string output_;
+  std::string tmpPath_;
+  FILE* file_;
+  uint64_t offset_;
+  bool compress_;
+#ifdef MBPLIB_HAVE_LIBZSTD
+  ZSTD_CCtx* cctx_ = nullptr;
+  std::vector<char> frame_;
+#endif
+};
+
+}  // namespace
+
+SbbtIndex SbbtIndex::Load(const std::string& path) {
+  FILE* file = OpenFile(path, "r");
+  SbbtIndex index;
+  IndexHeader header;
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            header.mark == INDEX_MARK;
+  if (ok) {
+    index.numInstructions = header.numInstructions;
+    index.numBranches = header.numBranches;
+    index.entries.resize(header.numEntries);
+    ok = std::fread(index.entries.data(), sizeof(Entry), header.numEntries,
+                    file) == header.numEntries;
+  }
+  fclose(file);
+  if (!ok) {
+    throw std::invalid_argument("SbbtIndex: file '" + path +
+                                "' is not a valid index.");
+  }
+  return index;
+}
+
+void SbbtIndex::save(const std::string& path) const {
+  static_assert(sizeof(Entry) == 24);
+  FILE* file = OpenFile(path, "w");
+  IndexHeader header{INDEX_MARK, numInstructions, numBranches, entries.size()};
+  try {
+    Write(file, &header, sizeof(header));
+    Write(file, entries.data(), entries.size() * sizeof(Entry));
+  } catch (...) {
+    fclose(file);
+    throw;
+  }
+  if (fclose(file) != 0) throw std::runtime_error(std::strerror(errno));
+}
+
+const SbbtIndex::Entry& SbbtIndex::find(int64_t instrNum) const {
+  // First chunk whose previous branch is not before instrNum.
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), instrNum,
+      [](const Entry& e, int64_t instrNum) { return e.instrNum < instrNum; });
+  return it == entries.begin() ? *it : *std::prev(it);
+}
+
+void MakeSeekableTrace(const std::string& input, const std::string& output,
+                       uint64_t chunkBranches, int level) {
+  if (chunkBranches == 0) {
+    throw std::invalid_argument("MakeSeekableTrace: chunks cannot be empty");
+  }
+  bool compress = EndsWith(output, ".sbbt.zst");
+  if (!compress && !EndsWith(output, ".sbbt")) {
+    throw std::invalid_argument("MakeSeekableTrace: output '" + output +
+                                "' must have extension .sbbt or .sbbt.zst");
+  }
+#ifndef MBPLIB_HAVE_LIBZSTD
+  if (compress) {
+    throw std::runtime_error(
+        "MakeSeekableTrace: MBPlib was built without libzstd, "
+        "so it cannot write .sbbt.zst traces");
+  }
+#endif
+  SbbtIndex index;
+  unsigned version;
+  {
+    // Let the reader check the header and the dictionary.
+    SbbtReader reader(input);
+    index.numInstructions = reader.numInstructions();
+    index.numBranches = reader.numBranches();
+    version = reader.version();
+  }
+  size_t recordSize = version == 1 ? sizeof(SbbtBranch) : sizeof(SbbtBranchV2);
+  // An uncompressed trace is already seekable, so it only needs the index.
+  // The paths are compared as files, since a file has many spellings.
+  bool indexOnly = !compress && SameFile(input, output);
+
+  std::unique_ptr<TraceSource> source = OpenTraceSource(input);
+  // The header of v2 traces includes the dictionary.
+  uint64_t numEntries = 0;
+  std::vector<char> header(SBBT_HEADER_SIZE +
+                           (version == 2 ? sizeof(numEntries) : 0));
+  ReadFully(*source, header.data(), header.size());
+  if (version == 2) {
+    memcpy(&numEntries, header.data() + SBBT_HEADER_SIZE, sizeof(numEntries));
+    size_t size = header.size();
+    header.resize(size + numEntries * sizeof(SbbtBranch));
+    ReadFully(*source, header.data() + size, header.size() - size);
+  }
+  std::vector<char> chunk(chunkBranches * recordSize);
+  std::unique_ptr<ChunkWriter> writer;
+  if (!indexOnly) {
+    writer = std::make_unique<ChunkWriter>(output, compress, level);
+    // The header gets its own frame so that every chunk starts with a branch.
+    writer->write(header.data(), header.size());
+  }
+
+  uint64_t branchNum = 0;
+  int64_t instrNum = 0;
+  while (true) {
+    size_t len = ReadFully(*source, chunk.data(), chunk.size());
+    if (len == 0) break;
+    if (len % recordSize != 0) {
+      throw std::invalid_argument("MakeSeekableTrace: trace '" + input +
+                                  "' is truncated");
+    }
+    uint64_t offset = indexOnly ? header.size() + branchNum * recordSize
+                                : writer->offset();
+    index.entries.push_back({offset, branchNum, instrNum});
+    size_t n = len / recordSize;
+    for (size_t i = 0; i < n; ++i) {
+      instrNum += SbbtRecordNinstr(chunk.data() + i * recordSize, version);
+    }
+    branchNum += n;
+    if (!indexOnly) writer->write(chunk.data(), len);
+  }
+  if (writer != nullptr) writer->close();
+  index.save(SbbtIndex::PathFor(output));
+}
+
+}  // namespace mbp
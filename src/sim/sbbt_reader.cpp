@@ -1,3 +1,9 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
@@ -6,102 +12,56 @@
 #include <limits>
 #include <sstream>
 
+#include "mbp/sim/ip_table.hpp"
 #include "mbp/sim/sbbt_reader.hpp"
+#include "sbbt_decode.hpp"
+#include "trace_source.hpp"
 
 namespace mbp {
 
-struct SbbtBranch {
-  unsigned opcode : 4;
-  unsigned padding : 7;
-  unsigned outcome : 1;
-  unsigned long long ip : 52;
-  unsigned ninstr : 12;
-  unsigned long long target : 52;
-};
-
-static constexpr uint64_t sign_extend_ip(uint64_t ip) {
-  constexpr uint64_t lastBit = uint64_t{1} << 51;
-  // If (ip & lastBit) == 0, then ip is unchanged,
-  // otherwise lastBit and the following bits get set to 1.
-  return (ip ^ lastBit) - lastBit;
-}
-
 SbbtReader::SbbtReader(const std::string& trace)
+    : SbbtReader(trace, SbbtReaderOptions{}) {}
+
+SbbtReader::SbbtReader(const std::string& trace,
+                       const SbbtReaderOptions& options)
     : buffer_{},
-      trace_(nullptr),
-      bufferStart_(0),
-      bufferEnd_(0),
+      source_(nullptr),
+      mapping_(nullptr),
+      mappingSize_(0),
+      bufferStart_(buffer_.data()),
+      bufferEnd_(buffer_.data()),
       instrCtr_(0),
-      header_{} {
-  // The trace can be either uncompressed...
-  size_t last_dot = trace.find_last_of('.');
-  // Note: we check that last_dot != 0 because we will write last_dot-1.
-  if (last_dot == trace.npos || last_dot == 0) {
-    throw std::invalid_argument("SbbtReader: file '" + trace +
-                                "' does not have extension.");
+      header_{},
+      recordSize_(sizeof(SbbtBranch)),
+      dictionary_(nullptr),
+      index_{},
+      columnar_(false),
+      columns_{},
+      branchCtr_(0),
+      staticIps_() {
+  size_t columnarLen = std::strlen(".sbbtc");
+  if (trace.size() > columnarLen &&
+      trace.compare(trace.size() - columnarLen, columnarLen, ".sbbtc") == 0) {
+    mapColumns(trace);
+    return;
   }
-  std::string extension = trace.substr(last_dot);
-  if (extension == ".sbbt") {
-    trace_ = fopen(trace.c_str(), "r");
-    if (trace_ == nullptr) {
-      throw std::system_error(errno, std::generic_category(), "fopen failed");
-    }
-  } else {
-    // Or compressed using a variety of tools: gzip, xz, zstd or lz4.
-    last_dot = trace.find_last_of('.', last_dot - 1);
-    if (last_dot == trace.npos) {
-      throw std::invalid_argument(
-          "SbbtReader: cannot recognize file type of '" + trace + "'.");
-    }
-    extension = trace.substr(last_dot);
-    if (extension == ".sbbt.xz") {
-      std::string cmd = "xz --decompress --keep --stdout " + trace;
-      trace_ = popen(cmd.c_str(), "r");
-      if (trace_ == nullptr) {
-        throw std::system_error(errno, std::generic_category(),
-                                "xz popen failed");
-      }
-    } else if (extension == ".sbbt.zst") {
-      std::string cmd = "zstd --decompress --stdout --quiet " + trace;
-      trace_ = popen(cmd.c_str(), "r");
-      if (trace_ == nullptr) {
-        throw std::system_error(errno, std::generic_category(),
-                                "zstd popen failed");
-      }
-    } else if (extension == ".sbbt.lz4") {
-      std::string cmd = "lz4 --decompress --stdout --quiet " + trace;
-      trace_ = popen(cmd.c_str(), "r");
-      if (trace_ == nullptr) {
-        throw std::system_error(errno, std::generic_category(),
-                                "lz4 popen failed");
-      }
-    } else if (extension == ".sbbt.gz") {
-      std::string cmd = "gzip --decompress --stdout --keep " + trace;
-      trace_ = popen(cmd.c_str(), "r");
-      if (trace_ == nullptr) {
-        throw std::system_error(errno, std::generic_category(),
-                                "gzip popen failed");
-      }
-    } else {
-      throw std::invalid_argument("SbbtReader: File type of '" + trace +
-                                  "' not supported.");
-    }
+
+  // Regular uncompressed files are mapped into memory and decoded in place.
+  // Anything else (e.g., a named pipe) is read into the buffer.
+  size_t extensionLen = std::strlen(".sbbt");
+  if (trace.size() <= extensionLen ||
+      trace.compare(trace.size() - extensionLen, extensionLen, ".sbbt") != 0 ||
+      !mapFile(trace)) {
+    source_ = OpenTraceSource(trace);
+    if (options.prefetch) source_ = MakePrefetchSource(std::move(source_));
   }
 
   // Read header and check version number.
-  while (bufferEnd_ - bufferStart_ < sizeof(SbbtHeader)) {
-    if (std::feof(trace_)) {
-      throw std::invalid_argument("SbbtReader: file '" + trace +
-                                  "' is empty or too small.");
-    }
-    size_t len = std::fread(buffer_.data() + bufferEnd_, sizeof(char),
-                            READ_SIZE, trace_);
-    bufferEnd_ += len;
-    if (std::ferror(trace_)) {
-      throw std::runtime_error(std::strerror(errno));
-    }
+  if (!fillBuffer(sizeof(SbbtHeader))) {
+    throw std::invalid_argument("SbbtReader: file '" + trace +
+                                "' is empty or too small.");
   }
-  memcpy(&header_, buffer_.data(), sizeof(SbbtHeader));
+  memcpy(&header_, bufferStart_, sizeof(SbbtHeader));
   bufferStart_ += sizeof(SbbtHeader);
   uint64_t markWoVersion = header_.sbbtMark & SBBT_MARK_WO_VERSION_MASK;
   if (markWoVersion != SBBT_MARK_WO_VERSION) {
@@ -110,62 +70,258 @@ SbbtReader::SbbtReader(const std::string& trace)
            << " (expected: " << SBBT_MARK_WO_VERSION << ").";
     throw std::invalid_argument(stream.str());
   }
-  if (header_.sbbtMark != SBBT_MARK_WITH_VERSION) {
+  if (header_.sbbtMark == SBBT_V2_MARK_WITH_VERSION) {
+    readDictionary(trace);
+  } else if (header_.sbbtMark != SBBT_MARK_WITH_VERSION) {
     std::stringstream stream;
     stream << "SbbtReader: Unsupported SBBT format version " << std::hex
            << (header_.sbbtMark & ~SBBT_MARK_WO_VERSION_MASK)
-           << " (expected 0x000001).";
+           << " (expected 0x000001 or 0x000002).";
     throw std::invalid_argument(stream.str());
   }
+
+  std::string indexPath = SbbtIndex::PathFor(trace);
+  if (access(indexPath.c_str(), F_OK) == 0) {
+    index_ = SbbtIndex::Load(indexPath);
+    bool outOfBounds =
+        mapping_ != nullptr &&
+        std::any_of(index_.entries.begin(), index_.entries.end(),
+                    [&](const auto& e) { return e.offset > mappingSize_; });
+    if (index_.numInstructions != header_.numInstructions ||
+        index_.numBranches != header_.numBranches || outOfBounds) {
+      throw std::invalid_argument("SbbtReader: index '" + indexPath +
+                                  "' does not match the trace.");
+    }
+  }
 }
 
 SbbtReader::SbbtReader(SbbtReader&& other)
     : buffer_(other.buffer_),
-      trace_(other.trace_),
+      source_(std::move(other.source_)),
+      mapping_(other.mapping_),
+      mappingSize_(other.mappingSize_),
       bufferStart_(other.bufferStart_),
       bufferEnd_(other.bufferEnd_),
       instrCtr_(other.instrCtr_),
-      header_(other.header_) {
-  other.trace_ = nullptr;
-  other.bufferStart_ = 0;
-  other.bufferEnd_ = 0;
+      header_(other.header_),
+      recordSize_(other.recordSize_),
+      dictionary_(std::move(other.dictionary_)),
+      index_(std::move(other.index_)),
+      columnar_(other.columnar_),
+      columns_(other.columns_),
+      branchCtr_(other.branchCtr_),
+      staticIps_(std::move(other.staticIps_)) {
+  if (mapping_ == nullptr) {
+    // The unread bytes were copied along with the buffer.
+    bufferStart_ = buffer_.data() + (other.bufferStart_ - other.buffer_.data());
+    bufferEnd_ = buffer_.data() + (other.bufferEnd_ - other.buffer_.data());
+  }
+  other.mapping_ = nullptr;
+  other.mappingSize_ = 0;
+  other.bufferStart_ = other.buffer_.data();
+  other.bufferEnd_ = other.buffer_.data();
   other.instrCtr_ = 0;
   other.header_ = {};
+  other.columnar_ = false;
+  other.columns_ = {};
+  other.branchCtr_ = 0;
 }
 
 SbbtReader::~SbbtReader() {
-  if (trace_ != nullptr) pclose(trace_);
+  if (mapping_ != nullptr) munmap(mapping_, mappingSize_);
 }
 
-bool SbbtReader::eof() const {
-  return bufferEnd_ - bufferStart_ < sizeof(SbbtBranch) && std::feof(trace_);
+bool SbbtReader::mapFile(const std::string& trace) {
+  // Other files are not opened here, because opening a named pipe
+  // blocks until its writer connects, and closing it would kill the writer.
+  struct stat st;
+  if (stat(trace.c_str(), &st) == -1) {
+    throw std::system_error(errno, std::generic_category(), "stat failed");
+  }
+  if (!S_ISREG(st.st_mode)) return false;
+  int fd = open(trace.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::system_error(errno, std::generic_category(), "open failed");
+  }
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  ::close(fd);
+  if (addr == MAP_FAILED) return false;
+  // The hints are only advisory, so their failure is not an error.
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise(addr, st.st_size, MADV_HUGEPAGE);
+#endif
+  mapping_ = static_cast<char*>(addr);
+  mappingSize_ = st.st_size;
+  bufferStart_ = mapping_;
+  bufferEnd_ = mapping_ + mappingSize_;
+  return true;
 }
 
-int64_t SbbtReader::nextBranch(Branch& b) {
-  // If the buffer does not contain a branch:
+void SbbtReader::mapColumns(const std::string& trace) {
+  if (!mapFile(trace) || mappingSize_ < sizeof(SbbtColumnarHeader)) {
+    throw std::invalid_argument("SbbtReader: file '" + trace +
+                                "' is empty or too small.");
+  }
+  SbbtColumnarHeader header;
+  memcpy(&header, mapping_, sizeof(SbbtColumnarHeader));
+  if (header.mark != SBBT_COLUMNAR_MARK) {
+    std::stringstream stream;
+    stream << "SbbtReader: Invalid columnar header " << std::hex
+           << header.mark << " (expected: " << SBBT_COLUMNAR_MARK << ").";
+    throw std::invalid_argument(stream.str());
+  }
+  uint64_t n = header.numBranches;
+  uint64_t numCheckpoints =
+      header.checkpointBranches == 0
+          ? 0
+          : (n + header.checkpointBranches - 1) / header.checkpointBranches;
+  // Tells whether a column of count elements of the given size fits the file.
+  auto fits = [&](uint64_t offset, uint64_t size, uint64_t count) {
+    return offset % COLUMN_ALIGNMENT == 0 && offset <= mappingSize_ &&
+           count <= (mappingSize_ - offset) / size;
+  };
+  if (header.size != mappingSize_ || header.checkpointBranches == 0 ||
+      header.numStaticIds > std::numeric_limits<uint32_t>::max() ||
+      !fits(header.ipOffset, sizeof(uint64_t), n) ||
+      !fits(header.targetOffset, sizeof(uint64_t), n) ||
+      !fits(header.flagsOffset, sizeof(uint8_t), n) ||
+      !fits(header.ninstrOffset, sizeof(uint16_t), n) ||
+      !fits(header.staticIdOffset, sizeof(uint32_t), n) ||
+      !fits(header.checkpointsOffset, sizeof(int64_t), numCheckpoints) ||
+      !fits(header.staticIpsOffset, sizeof(uint64_t), header.numStaticIds)) {
+    throw std::invalid_argument("SbbtReader: columnar trace '" + trace +
+                                "' is corrupted or truncated.");
+  }
+  header_ = {SBBT_MARK_WITH_VERSION, header.numInstructions, n};
+  columnar_ = true;
+  columns_ = {
+      reinterpret_cast<const uint64_t*>(mapping_ + header.ipOffset),
+      reinterpret_cast<const uint64_t*>(mapping_ + header.targetOffset),
+      reinterpret_cast<const uint8_t*>(mapping_ + header.flagsOffset),
+      reinterpret_cast<const uint16_t*>(mapping_ + header.ninstrOffset),
+      reinterpret_cast<const uint32_t*>(mapping_ + header.staticIdOffset),
+      reinterpret_cast<const int64_t*>(mapping_ + header.checkpointsOffset),
+      header.checkpointBranches,
+  };
+  const auto* staticIps =
+      reinterpret_cast<const uint64_t*>(mapping_ + header.staticIpsOffset);
+  IpTable<bool> seen(header.numStaticIds);
+  for (uint64_t id = 0; id < header.numStaticIds; ++id) {
+    bool& repeated = seen[staticIps[id]];
+    if (repeated) {
+      throw std::invalid_argument("SbbtReader: columnar trace '" + trace +
+                                  "' has repeated static branches.");
+    }
+    repeated = true;
+  }
+  staticIps_.assign(staticIps, staticIps + header.numStaticIds);
+  bufferStart_ = bufferEnd_;
+}
+
+void SbbtReader::readDictionary(const std::string& trace) {
+  uint64_t numEntries;
+  if (!fillBuffer(sizeof(numEntries))) {
+    throw std::invalid_argument("SbbtReader: file '" + trace +
+                                "' ends before its dictionary.");
+  }
+  memcpy(&numEntries, bufferStart_, sizeof(numEntries));
+  bufferStart_ += sizeof(numEntries);
+  if (numEntries > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("SbbtReader: dictionary of '" + trace +
+                                "' is too large.");
+  }
+  dictionary_ = std::make_unique<SbbtDictionary>();
+  dictionary_->words.resize(2 * numEntries);
+  char* dst = reinterpret_cast<char*>(dictionary_->words.data());
+  for (uint64_t i = 0; i < numEntries; ++i) {
+    if (!fillBuffer(sizeof(SbbtBranch))) {
+      throw std::invalid_argument("SbbtReader: file '" + trace +
+                                  "' ends before its dictionary.");
+    }
+    memcpy(dst + i * sizeof(SbbtBranch), bufferStart_, sizeof(SbbtBranch));
+    bufferStart_ += sizeof(SbbtBranch);
+  }
+  // All the static branch identifiers are assigned up front,
+  // so that the decoding only has to look them up.
+  dictionary_->staticIds.resize(numEntries);
+  // Identifier of each address plus one, so that 0 means a new address.
+  IpTable<uint32_t> staticIds(numEntries);
+  for (uint64_t i = 0; i < numEntries; ++i) {
+    const auto* entry =
+        reinterpret_cast<const SbbtBranch*>(dst + i * sizeof(SbbtBranch));
+    uint64_t ip = sign_extend_ip(entry->ip);
+    uint32_t& id = staticIds[ip];
+    if (id == 0) {
+      staticIps_.push_back(ip);
+      id = staticIps_.size();
+    }
+    dictionary_->staticIds[i] = id - 1;
+  }
+  recordSize_ = sizeof(SbbtBranchV2);
+}
+
+bool SbbtReader::fillBuffer(size_t minBytes) {
+  // If the buffer does not contain enough bytes:
   // (1) move the partial branch bytes to the beginning of the buffer and
   // (2) perform a new read.
-  while (bufferEnd_ - bufferStart_ < sizeof(SbbtBranch)) {
-    if (std::feof(trace_)) {
-      // The maximum value of int64_t must be returned
-      // if there are not more branches.
+  // A mapped trace is already complete.
+  while (static_cast<size_t>(bufferEnd_ - bufferStart_) < minBytes) {
+    if (mapping_ != nullptr || source_->eof()) return false;
+    size_t pending = bufferEnd_ - bufferStart_;
+    memmove(buffer_.data(), bufferStart_, pending);
+    bufferStart_ = buffer_.data();
+    bufferEnd_ = buffer_.data() + pending;
+    bufferEnd_ += source_->read(buffer_.data() + pending, READ_SIZE);
+  }
+  return true;
+}
+
+bool SbbtReader::eof() const {
+  if (columnar_) return branchCtr_ >= header_.numBranches;
+  return static_cast<size_t>(bufferEnd_ - bufferStart_) < recordSize_ &&
+         (mapping_ != nullptr || source_->eof());
+}
+
+int64_t SbbtReader::nextBranch(Branch& b) {
+  if (columnar_) {
+    uint64_t ip, target;
+    uint8_t opcode, outcome;
+    int64_t instrNum;
+    uint32_t id;
+    BranchArrays branch = {&ip, &target, &opcode, &outcome, &instrNum, &id};
+    if (nextColumnarBranches(branch, 1) == 0) {
       return std::numeric_limits<int64_t>::max();
     }
-    for (size_t i = bufferStart_; i < bufferEnd_; ++i) {
-      buffer_[i - bufferStart_] = buffer_[i];
-    }
-    bufferEnd_ -= bufferStart_;
-    bufferStart_ = 0;
-    size_t len = std::fread(buffer_.data() + bufferEnd_, sizeof(char),
-                            READ_SIZE, trace_);
-    bufferEnd_ += len;
-    if (std::ferror(trace_)) {
-      throw std::runtime_error(std::strerror(errno));
-    }
+    b = Branch{ip, target, static_cast<Branch::OpCode>(opcode), outcome, id};
+    return instrNum;
+  }
+  if (static_cast<size_t>(bufferEnd_ - bufferStart_) < recordSize_ &&
+      !fillBuffer(recordSize_)) {
+    // The maximum value of int64_t must be returned
+    // if there are not more branches.
+    return std::numeric_limits<int64_t>::max();
   }
   static_assert(sizeof(SbbtBranch) == SbbtReader::SIZEOF_SBBT_BRANCH);
-  SbbtBranch* srcBranch =
-      reinterpret_cast<SbbtBranch*>(buffer_.data() + bufferStart_);
+  if (dictionary_ != nullptr) {
+    uint64_t ip, target;
+    uint8_t opcode, outcome;
+    int64_t instrNum;
+    uint32_t id;
+    instrCtr_ = DecodeSbbtV2Branches(bufferStart_, 1, instrCtr_, *dictionary_,
+                                     {&ip, &target, &opcode, &outcome,
+                                      &instrNum, &id});
+    bufferStart_ += recordSize_;
+    b = Branch{ip, target, static_cast<Branch::OpCode>(opcode), outcome, id};
+    return instrCtr_;
+  }
+  const SbbtBranch* srcBranch =
+      reinterpret_cast<const SbbtBranch*>(bufferStart_);
   bufferStart_ += sizeof(SbbtBranch);
   instrCtr_ += srcBranch->ninstr;
   b = Branch{sign_extend_ip(srcBranch->ip), sign_extend_ip(srcBranch->target),
@@ -174,4 +330,173 @@ int64_t SbbtReader::nextBranch(Branch& b) {
   return instrCtr_;
 }
 
+size_t SbbtReader::nextBranches(Branch* branches, int64_t* instrNums,
+                                size_t n) {
+  if (columnar_ || dictionary_ != nullptr) {
+    size_t read = 0;
+    while (read < n) {
+      int64_t instrNum = nextBranch(branches[read]);
+      if (instrNum == std::numeric_limits<int64_t>::max()) break;
+      instrNums[read++] = instrNum;
+    }
+    return read;
+  }
+  size_t read = 0;
+  while (read < n) {
+    if (static_cast<size_t>(bufferEnd_ - bufferStart_) < sizeof(SbbtBranch) &&
+        !fillBuffer(sizeof(SbbtBranch))) {
+      break;
+    }
+    size_t available = (bufferEnd_ - bufferStart_) / sizeof(SbbtBranch);
+    size_t len = std::min(n - read, available);
+    const SbbtBranch* srcBranch =
+        reinterpret_cast<const SbbtBranch*>(bufferStart_);
+    int64_t instrCtr = instrCtr_;
+    for (size_t i = 0; i < len; ++i) {
+      instrCtr += srcBranch[i].ninstr;
+      instrNums[read + i] = instrCtr;
+      branches[read + i] =
+          Branch{sign_extend_ip(srcBranch[i].ip),
+                 sign_extend_ip(srcBranch[i].target),
+                 static_cast<Branch::OpCode>(srcBranch[i].opcode),
+                 static_cast<uint8_t>(srcBranch[i].outcome)};
+    }
+    instrCtr_ = instrCtr;
+    bufferStart_ += len * sizeof(SbbtBranch);
+    read += len;
+  }
+  return read;
+}
+
+size_t SbbtReader::nextBranches(const BranchArrays& branches, size_t n) {
+  if (columnar_) return nextColumnarBranches(branches, n);
+  size_t read = 0;
+  while (read < n) {
+    if (static_cast<size_t>(bufferEnd_ - bufferStart_) < recordSize_ &&
+        !fillBuffer(recordSize_)) {
+      break;
+    }
+    size_t available = (bufferEnd_ - bufferStart_) / recordSize_;
+    size_t len = std::min(n - read, available);
+    uint32_t* staticId =
+        branches.staticId == nullptr ? nullptr : branches.staticId + read;
+    BranchArrays out = {branches.ip + read, branches.target + read,
+                        branches.opcode + read, branches.outcome + read,
+                        branches.instrNum + read, staticId};
+    if (dictionary_ == nullptr) {
+      instrCtr_ = DecodeSbbtBranches(bufferStart_, len, instrCtr_, out);
+      if (staticId != nullptr) {
+        std::fill_n(staticId, len, Branch::NO_STATIC_ID);
+      }
+    } else {
+      instrCtr_ = DecodeSbbtV2Branches(bufferStart_, len, instrCtr_,
+                                       *dictionary_, out);
+    }
+    bufferStart_ += len * recordSize_;
+    read += len;
+  }
+  return read;
+}
+
+size_t SbbtReader::nextColumnarBranches(const BranchArrays& branches,
+                                        size_t n) {
+  size_t len = std::min<uint64_t>(n, header_.numBranches - branchCtr_);
+  // The ips and targets are stored as they are returned.
+  memcpy(branches.ip, columns_.ip + branchCtr_, len * sizeof(uint64_t));
+  memcpy(branches.target, columns_.target + branchCtr_,
+         len * sizeof(uint64_t));
+  const uint8_t* flags = columns_.flags + branchCtr_;
+  const uint16_t* ninstr = columns_.ninstr + branchCtr_;
+  int64_t instrCtr = instrCtr_;
+  for (size_t i = 0; i < len; ++i) {
+    branches.opcode[i] = flags[i] & 0xF;
+    branches.outcome[i] = flags[i] >> COLUMN_OUTCOME_SHIFT;
+    instrCtr += ninstr[i];
+    branches.instrNum[i] = instrCtr;
+  }
+  if (branches.staticId != nullptr) {
+    const uint32_t* staticId = columns_.staticId + branchCtr_;
+    // Like the entries of v2 traces, the identifiers are checked
+    // so that they can index arrays of numStaticIds() elements.
+    uint32_t maxId = 0;
+    for (size_t i = 0; i < len; ++i) maxId = std::max(maxId, staticId[i]);
+    if (len != 0 && maxId >= staticIps_.size()) {
+      throw std::invalid_argument(
+          "SbbtReader: a branch has static identifier " +
+          std::to_string(maxId) + " of " +
+          std::to_string(staticIps_.size()) + ".");
+    }
+    memcpy(branches.staticId, staticId, len * sizeof(uint32_t));
+  }
+  instrCtr_ = instrCtr;
+  branchCtr_ += len;
+  return len;
+}
+
+void SbbtReader::seekColumnar(int64_t instrNum) {
+  uint64_t n = header_.numBranches;
+  uint64_t numCheckpoints =
+      (n + columns_.checkpointBranches - 1) / columns_.checkpointBranches;
+  // Jump to the last checkpoint before instrNum, or to the start.
+  const int64_t* checkpoints = columns_.checkpoints;
+  const int64_t* it =
+      std::lower_bound(checkpoints, checkpoints + numCheckpoints, instrNum);
+  uint64_t checkpoint = it == checkpoints ? 0 : it - checkpoints - 1;
+  branchCtr_ = std::min(checkpoint * columns_.checkpointBranches, n);
+  instrCtr_ = numCheckpoints == 0 ? 0 : checkpoints[checkpoint];
+  // Skip the branches before instrNum.
+  while (branchCtr_ < n &&
+         instrCtr_ + columns_.ninstr[branchCtr_] < instrNum) {
+    instrCtr_ += columns_.ninstr[branchCtr_++];
+  }
+}
+
+bool SbbtReader::seekable() const {
+  if (columnar_) return true;
+  return !index_.entries.empty() &&
+         (mapping_ != nullptr || source_->seekable());
+}
+
+void SbbtReader::seek(int64_t instrNum) {
+  if (columnar_) return seekColumnar(instrNum);
+  bool passed = instrCtr_ != 0 && instrCtr_ >= instrNum;
+  if (seekable()) {
+    const SbbtIndex::Entry& entry = index_.find(instrNum);
+    // Jump unless the branch is in the chunk being read.
+    if (passed || entry.instrNum > instrCtr_) {
+      if (mapping_ != nullptr) {
+        bufferStart_ = mapping_ + entry.offset;
+      } else {
+        source_->seek(entry.offset);
+        bufferStart_ = buffer_.data();
+        bufferEnd_ = buffer_.data();
+      }
+      instrCtr_ = entry.instrNum;
+      passed = false;
+    }
+  }
+  if (passed) {
+    throw std::invalid_argument(
+        "SbbtReader: cannot seek backwards in a trace that is not seekable.");
+  }
+  // Skip the branches before instrNum without decoding them.
+  while (true) {
+    if (static_cast<size_t>(bufferEnd_ - bufferStart_) < recordSize_ &&
+        !fillBuffer(recordSize_)) {
+      return;
+    }
+    size_t available = (bufferEnd_ - bufferStart_) / recordSize_;
+    for (size_t i = 0; i < available; ++i) {
+      unsigned ninstr =
+          SbbtRecordNinstr(bufferStart_ + i * recordSize_, version());
+      if (instrCtr_ + ninstr >= instrNum) {
+        bufferStart_ += i * recordSize_;
+        return;
+      }
+      instrCtr_ += ninstr;
+    }
+    bufferStart_ += available * recordSize_;
+  }
+}
+
 }  // namespace mbp
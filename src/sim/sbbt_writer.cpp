@@ -17,6 +17,11 @@ static constexpr int IP_SHIFT = 12;
 static constexpr int OUTCOME_SHIFT = 11;
 static constexpr int OPCODE_SHIFT = 0;
 static constexpr int IP_DIFF_SHIFT = 0;
+// Fields of the branch records of v2.
+static constexpr int V2_IP_DIFF_SHIFT = 32;
+static constexpr int V2_OUTCOME_SHIFT = 48;
+// Compression level of v2 traces before the dictionary is written.
+static constexpr int V2_FIRST_PASS_LEVEL = 1;
 
 struct SbbtBranch {
   uint64_t pkg0, pkg1;
@@ -27,14 +32,40 @@ static constexpr bool Is52BitsSignExtended(uint64_t ip) {
   return (ip & LAST_13_BITS) == LAST_13_BITS || (ip & LAST_13_BITS) == 0;
 }
 
+/**
+ * Returns the command that compresses its input into the file appended to it.
+ */
+static std::string ZstdCommand(int compressionLevel) {
+  // Levels above 19 need --ultra.
+  std::string ultra = compressionLevel > 19 ? "--ultra " : "";
+  return "zstd " + ultra + "-" + std::to_string(compressionLevel) +
+         " --force -o ";
+}
+
 SbbtWriter::SbbtWriter(const std::string& filename, uint64_t numInstructions,
-                       uint64_t numBranches)
-    : filename_(filename) {
+                       uint64_t numBranches, int compressionLevel,
+                       unsigned version)
+    : filename_(filename),
+      compressionLevel_(compressionLevel),
+      version_(version) {
   if (numInstructions == 0) {
     throw std::invalid_argument("SbbtWriter: numInstructions must be positive");
   }
+  if (compressionLevel < 1 || compressionLevel > MAX_COMPRESSION_LEVEL) {
+    throw std::invalid_argument(
+        "SbbtWriter: compressionLevel must be between 1 and 22");
+  }
+  if (version != 1 && version != 2) {
+    throw std::invalid_argument("SbbtWriter: version must be 1 or 2");
+  }
   open();
-  writeHeader(numInstructions, numBranches);
+  if (version_ == 1) {
+    writeHeader(numInstructions, numBranches);
+  } else {
+    // The header is written by close(), along with the dictionary.
+    numInstructionsHeader_ = numInstructions;
+    numBranchesHeader_ = numBranches;
+  }
 }
 
 SbbtWriter::SbbtWriter(const std::string& filename) : filename_(filename) {
@@ -49,6 +80,10 @@ SbbtWriter::SbbtWriter(SbbtWriter&& o) {
   numInstructionsHeader_ = o.numInstructionsHeader_;
   numBranchesHeader_ = o.numBranchesHeader_;
   filename_ = o.filename_;
+  compressionLevel_ = o.compressionLevel_;
+  version_ = o.version_;
+  dictionary_ = std::move(o.dictionary_);
+  dictionaryIndices_ = std::move(o.dictionaryIndices_);
   bufferSize_ = o.bufferSize_;
   headerWritten_ = o.headerWritten_;
 
@@ -79,7 +114,8 @@ void SbbtWriter::open() {
     throw std::invalid_argument("SbbtWriter: file was '" + filename_ +
                                 "' but extension has to be .sbbt.zst");
   }
-  std::string cmd = "zstd --ultra -22 --force -o " + filename_;
+  int level = version_ == 1 ? compressionLevel_ : V2_FIRST_PASS_LEVEL;
+  std::string cmd = ZstdCommand(level) + filename_;
   pipe_ = popen(cmd.c_str(), "w");
   if (pipe_ == nullptr) {
     throw std::runtime_error(std::strerror(errno));
@@ -90,9 +126,15 @@ void SbbtWriter::writeHeader(uint64_t numInstructions, uint64_t numBranches) {
   assert(numInstructions != 0);
   assert(pipe_ != nullptr);
   SbbtHeader traceHeader;
+  if (version_ == 2) traceHeader.sbbtMark = SBBT_V2_MARK;
   traceHeader.numInstructions = numInstructions;
   traceHeader.numBranches = numBranches;
   fwrite(&traceHeader, sizeof(traceHeader), 1, pipe_);
+  if (version_ == 2) {
+    uint64_t numEntries = dictionary_.size() / 2;
+    fwrite(&numEntries, sizeof(numEntries), 1, pipe_);
+    fwrite(dictionary_.data(), sizeof(uint64_t), dictionary_.size(), pipe_);
+  }
   if (std::ferror(pipe_)) {
     throw std::runtime_error(std::strerror(errno));
   }
@@ -126,11 +168,29 @@ void SbbtWriter::addBranch(uint64_t instrNum, uint64_t ip, uint64_t target,
     throw std::invalid_argument("SbbtWriter: invalid opcode");
   }
 
-  if (bufferSize_ == BUFFER_SIZE) writeBuffer();
-  buffer_[bufferSize_++] = (ip << IP_SHIFT) |
-                           (static_cast<uint64_t>(outcome) << OUTCOME_SHIFT) |
-                           (static_cast<uint64_t>(opcode) << OPCODE_SHIFT);
-  buffer_[bufferSize_++] = (target << IP_SHIFT) | (ipdiff << IP_DIFF_SHIFT);
+  // There must be room for a v1 record, which takes two words.
+  while (bufferSize_ + 2 > BUFFER_SIZE) writeBuffer();
+  if (version_ == 1) {
+    buffer_[bufferSize_++] = (ip << IP_SHIFT) |
+                             (static_cast<uint64_t>(outcome) << OUTCOME_SHIFT) |
+                             (static_cast<uint64_t>(opcode) << OPCODE_SHIFT);
+    buffer_[bufferSize_++] = (target << IP_SHIFT) | (ipdiff << IP_DIFF_SHIFT);
+  } else {
+    auto [it, inserted] = dictionaryIndices_.try_emplace(
+        DictionaryKey{ip, target, opcode}, dictionary_.size() / 2);
+    if (inserted) {
+      if (it->second == UINT32_MAX) {
+        throw std::runtime_error("SbbtWriter: too many dictionary entries");
+      }
+      // Entries are encoded as v1 records of not taken branches.
+      dictionary_.push_back((ip << IP_SHIFT) |
+                            (static_cast<uint64_t>(opcode) << OPCODE_SHIFT));
+      dictionary_.push_back(target << IP_SHIFT);
+    }
+    buffer_[bufferSize_++] =
+        it->second | (ipdiff << V2_IP_DIFF_SHIFT) |
+        (static_cast<uint64_t>(outcome) << V2_OUTCOME_SHIFT);
+  }
   lastBranchInstrNum_ = instrNum;
   numBranches_ += 1;
 }
@@ -151,11 +211,13 @@ void SbbtWriter::flush() {
 }
 
 void SbbtWriter::close() {
-  close(headerWritten_ ? numInstructionsHeader_ : lastBranchInstrNum_);
+  close(numInstructionsHeader_ != 0 ? numInstructionsHeader_
+                                    : lastBranchInstrNum_);
 }
 
 void SbbtWriter::close(uint64_t numInstructions) {
-  if (headerWritten_) {
+  // The numbers of the header are known if they were given to the constructor.
+  if (numInstructionsHeader_ != 0) {
     if (numInstructionsHeader_ != numInstructions) {
       throw std::runtime_error(
           "SbbtWriter: You specified a different number of instructions "
@@ -185,7 +247,7 @@ void SbbtWriter::close(uint64_t numInstructions) {
     throw std::runtime_error(strerror(errno));
   }
   std::string tmpfile = filename_ + ".tmp";
-  cmd = "zstd --ultra -22 --force -o " + tmpfile;
+  cmd = ZstdCommand(compressionLevel_) + tmpfile;
   pipe_ = popen(cmd.c_str(), "w");
   if (pipe_ == nullptr) {
     throw std::runtime_error(strerror(errno));
@@ -1,44 +1,143 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cerrno>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
 
+#include "mbp/sim/ip_table.hpp"
 #include "mbp/sim/sbbt_reader.hpp"
 #include "mbp/sim/simulator.hpp"
+#include "mbp/utils/serialization.hpp"
 #include "nlohmann/json.hpp"
 
 namespace mbp {
 
+static void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program;
+  std::cerr << " <trace> [<warm_instr> <sim_instr>] [<options>]\n";
+  std::cerr << "Options:\n";
+  std::cerr << "  --prefetch     Decompress the trace in a background thread\n";
+  std::cerr << "  --threads=<n>  Simulate the predictors of a parallel "
+               "simulation in n threads\n";
+  std::cerr << "  --snapshot-dir=<dir>  Store the predictor after the warmup "
+               "in dir and reuse it\n";
+  std::cerr << "  --interval=<instr>  Also report the statistics of each "
+               "interval of instr instructions\n";
+  std::cerr << "  --profile[=<period>]  Also report the time spent "
+               "in each phase, timing 1 of every period branches\n";
+  std::cerr << "  --host-counters  Also report the hardware performance "
+               "counters of the host\n";
+  std::cerr << "  --cache-dir=<dir>  Store the output in dir and reuse it "
+               "in identical simulations\n";
+  std::cerr << "  --cache-tag=<tag>  Version of the predictor "
+               "for the cached outputs\n";
+  std::cerr << "  --format=<format>  Print the output as json (default), "
+               "or as records in ndjson, cbor or msgpack\n";
+}
+
+/**
+ * Parses the value of an option as a positive integer not greater than max,
+ * exiting if it is not valid.
+ */
+static int64_t ParsePositiveOption(const char* option, const char* value,
+                                   int64_t max) {
+  char* endptr;
+  errno = 0;
+  int64_t x = strtoll(value, &endptr, 0);
+  if (errno != 0 || endptr == value || *endptr != '\0' || x < 1 || x > max) {
+    std::cerr << option << " must be a positive integer not greater than "
+              << max << "\n";
+    exit(ERR_INPUT_DATA);
+  }
+  return x;
+}
+
 SimArgs ParseCmdLineArgs(int argc, char** argv) {
   SimArgs args;
-  if (argc != 2 && argc != 4) {
-    std::cerr << "Usage: " << argv[0];
-    std::cerr << " <trace> [<warm_instr> <sim_instr>]\n";
+  std::vector<char*> positional;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--prefetch") == 0) {
+      args.prefetch = true;
+    } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      args.threads = ParsePositiveOption("--threads", argv[i] + 10,
+                                         std::numeric_limits<int>::max());
+    } else if (strncmp(argv[i], "--snapshot-dir=", 15) == 0) {
+      args.snapshotDir = argv[i] + 15;
+    } else if (strcmp(argv[i], "--host-counters") == 0) {
+      args.hostCounters = true;
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      args.profilePeriod = DEFAULT_PROFILE_PERIOD;
+    } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+      char* endptr;
+      args.profilePeriod = strtoll(argv[i] + 10, &endptr, 0);
+      if (*endptr != '\0' || args.profilePeriod < 1) {
+        std::cerr << "--profile must be a positive integer\n";
+        exit(ERR_INPUT_DATA);
+      }
+    } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+      args.cacheDir = argv[i] + 12;
+    } else if (strncmp(argv[i], "--cache-tag=", 12) == 0) {
+      args.cacheTag = argv[i] + 12;
+    } else if (strncmp(argv[i], "--interval=", 11) == 0) {
+      char* endptr;
+      args.intervalInstrs = strtoll(argv[i] + 11, &endptr, 0);
+      if (*endptr != '\0' || args.intervalInstrs < 0) {
+        std::cerr << "--interval must be a non-negative integer\n";
+        exit(ERR_INPUT_DATA);
+      }
+    } else if (strncmp(argv[i], "--format=", 9) == 0) {
+      if (!detail::ParseOutputFormat(argv[i] + 9, args.outputFormat)) {
+        std::cerr << "--format must be json, ndjson, cbor or msgpack\n";
+        exit(ERR_INPUT_DATA);
+      }
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      std::cerr << "Unknown option '" << argv[i] << "'\n";
+      PrintUsage(argv[0]);
+      exit(ERR_INPUT_DATA);
+    } else {
+      positional.push_back(argv[i]);
+    }
+  }
+  if (positional.size() != 1 && positional.size() != 3) {
+    PrintUsage(argv[0]);
     exit(ERR_INPUT_DATA);
   }
-  args.tracepath = argv[1];
-  if (argc == 2) {
+  args.tracepath = positional[0];
+  if (positional.size() == 1) {
     args.warmupInstrs = 0;
     args.simInstr = 0;
   } else {
     char* endptr;
-    if ((args.warmupInstrs = strtoll(argv[2], &endptr, 0)) < 0) {
+    if ((args.warmupInstrs = strtoll(positional[1], &endptr, 0)) < 0) {
       std::cerr << "<warm_instr> cannot be negative\n";
       exit(ERR_INPUT_DATA);
     }
-    if (errno != 0 || endptr == argv[2]) {
-      std::cerr << '\'' << argv[2] << '\'';
+    if (errno != 0 || endptr == positional[1]) {
+      std::cerr << '\'' << positional[1] << '\'';
       std::cerr << " could not be parsed as integer for <warm_instr>\n";
       exit(ERR_INPUT_DATA);
     }
-    if ((args.simInstr = strtoll(argv[3], &endptr, 0)) < 0) {
+    if ((args.simInstr = strtoll(positional[2], &endptr, 0)) < 0) {
       std::cerr << "<sim_instr> cannot be negative\n";
       exit(ERR_INPUT_DATA);
     }
-    if (errno != 0 || endptr == argv[3]) {
-      std::cerr << '\'' << argv[3] << '\'';
+    if (errno != 0 || endptr == positional[2]) {
+      std::cerr << '\'' << positional[2] << '\'';
       std::cerr << " could not be parsed as integer for <sim_instr>\n";
       exit(ERR_INPUT_DATA);
     }
@@ -65,59 +164,393 @@ SimArgs ParseCmdLineArgs(int argc, char** argv) {
  * this makes the mpki exactly proportional to the mispredictions.
  */
 
-constexpr size_t MAX_NUM_LISTED_BRANCHES = 20;
+detail::TraceRun detail::EndTraceRun(
+    const SbbtReader& trace, bool exhaustedTrace,
+    std::chrono::high_resolution_clock::time_point startTime) {
+  auto endTime = std::chrono::high_resolution_clock::now();
+  double simulationTime =
+      std::chrono::duration<double>(endTime - startTime).count();
+  return {static_cast<int64_t>(trace.numInstructions()),
+          trace.lastInstrRead(), exhaustedTrace, simulationTime,
+          trace.staticIps()};
+}
 
-json Simulate(Predictor* branchPredictor, const SimArgs& args) {
-  const auto& [tracepath, warmupInstrs, simInstr, stopAtInstr] = args;
-  SbbtReader trace{tracepath};
-  struct BranchInfo {
-    int64_t occurrences, misses;
+/**
+ * Returns the statistics of an interval of a simulation
+ * that ends at endInstr, or null if the interval starts after the end.
+ */
+static json IntervalJson(const detail::IntervalStats& interval,
+                         int64_t length, int64_t endInstr) {
+  // The last interval ends with the simulation.
+  int64_t numInstr =
+      std::min(interval.startInstr + length, endInstr) - interval.startInstr;
+  if (numInstr <= 0) return nullptr;
+  double throughput =
+      interval.seconds > 0 ? interval.numBranches / interval.seconds : 0;
+  return {
+      {"start_instr", interval.startInstr},
+      {"num_instr", numInstr},
+      {"num_conditonal_branches", interval.numBranches},
+      {"mispredictions", interval.mispredictions},
+      {"mpki", 1000.0 * interval.mispredictions / numInstr},
+      {"branches_per_second", throughput},
   };
-  std::unordered_map<uint64_t, BranchInfo> branchInfo;
-  int64_t numBranches = 0;
-  int64_t mispredictions = 0;
-  std::vector<std::string> errors;
+}
 
-  auto startTime = std::chrono::high_resolution_clock::now();
-  Branch b;
-  int64_t instrNum = 0;
-  while ((instrNum = trace.nextBranch(b)) < stopAtInstr) {
-    if (b.isConditional()) {
-      bool predictedTaken = branchPredictor->predict(b.ip());
-      branchPredictor->train(b);
-      if (instrNum >= warmupInstrs) {
-        numBranches += 1;
-        branchInfo[b.ip()].occurrences += 1;
-        bool mispredicted = predictedTaken != b.isTaken();
-        mispredictions += mispredicted;
-        branchInfo[b.ip()].misses += mispredicted;
-      }
+detail::IntervalRecorder::IntervalRecorder(const SimArgs& args,
+                                           int64_t endInstr, SimStats& stats)
+    : stats_(stats),
+      sink_(args.intervalSink),
+      keep_(!args.intervalSink || !args.cacheDir.empty()),
+      endInstr_(endInstr),
+      length_(args.intervalInstrs),
+      nextBoundary_(args.intervalInstrs == 0
+                        ? std::numeric_limits<int64_t>::max()
+                        : args.warmupInstrs),
+      started_(false) {}
+
+void detail::IntervalRecorder::advance(int64_t instrNum) {
+  auto now = std::chrono::steady_clock::now();
+  if (!started_) {
+    // The first interval starts at the first branch after the warmup.
+    started_ = true;
+    startInstr_ = nextBoundary_;
+    startBranches_ = stats_.numBranches;
+    startMispredictions_ = stats_.mispredictions;
+    startTime_ = now;
+    nextBoundary_ += length_;
+  }
+  while (instrNum >= nextBoundary_) {
+    record(now);
+    nextBoundary_ += length_;
+  }
+}
+
+void detail::IntervalRecorder::finish() {
+  if (started_) record(std::chrono::steady_clock::now());
+}
+
+void detail::IntervalRecorder::record(
+    std::chrono::steady_clock::time_point now) {
+  IntervalStats interval{
+      startInstr_,
+      stats_.numBranches - startBranches_,
+      stats_.mispredictions - startMispredictions_,
+      std::chrono::duration<double>(now - startTime_).count(),
+  };
+  if (sink_) {
+    json j = IntervalJson(interval, length_, endInstr_);
+    if (!j.is_null()) sink_(j);
+  }
+  if (keep_) stats_.intervals.push_back(interval);
+  startInstr_ += length_;
+  startBranches_ = stats_.numBranches;
+  startMispredictions_ = stats_.mispredictions;
+  startTime_ = now;
+}
+
+detail::PhaseProfiler::PhaseProfiler(int64_t period)
+    : period_(period), countdown_(period) {
+  overheadTicks_ = std::numeric_limits<uint64_t>::max();
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t start = now();
+    overheadTicks_ = std::min(overheadTicks_, now() - start);
+  }
+  startTicks_ = now();
+  startTime_ = std::chrono::steady_clock::now();
+}
+
+json detail::PhaseProfiler::report() const {
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - startTime_)
+                       .count();
+  double ticksPerSecond = seconds > 0 ? (now() - startTicks_) / seconds : 0;
+  // Only the decoding is timed for every branch.
+  double scale = numSampled_ > 0
+                     ? static_cast<double>(numBranches_) / numSampled_
+                     : 0;
+  static const char* const PHASE_NAMES[NUM_PHASES] = {
+      "decode", "predict", "train", "track", "stats",
+  };
+  json phases;
+  double attributedSeconds = 0;
+  for (int i = 0; i < NUM_PHASES; ++i) {
+    double ticks;
+    if (i == DECODE) {
+      ticks = ticks_[i];
+    } else {
+      uint64_t overhead = overheadTicks_ * numSampled_;
+      ticks = (ticks_[i] > overhead ? ticks_[i] - overhead : 0) * scale;
     }
-    branchPredictor->track(b);
+    double phaseSeconds = ticksPerSecond > 0 ? ticks / ticksPerSecond : 0;
+    attributedSeconds += phaseSeconds;
+    phases[PHASE_NAMES[i]] = {
+        {"seconds", phaseSeconds},
+        {"fraction", seconds > 0 ? phaseSeconds / seconds : 0},
+        {"ticks_per_branch", numBranches_ > 0 ? ticks / numBranches_ : 0},
+    };
   }
-  auto endTime = std::chrono::high_resolution_clock::now();
-  double simulationTime =
-      std::chrono::duration<double>(endTime - startTime).count();
-  // See Note 0.
-  int64_t metricInstr =
-      simInstr == 0 ? trace.numInstructions() - warmupInstrs : simInstr;
-  if (simInstr != 0 && trace.eof()) {
+#if defined(__x86_64__) || defined(__i386__)
+  const char* timer = "rdtsc";
+#else
+  const char* timer = "steady_clock";
+#endif
+  return {
+      {"timer", timer},
+      {"ticks_per_second", ticksPerSecond},
+      // Subtracted from each sampled measurement.
+      {"timer_overhead_ticks", overheadTicks_},
+      {"sample_period", period_},
+      {"num_branches", numBranches_},
+      {"num_sampled_branches", numSampled_},
+      {"seconds", seconds},
+      {"phases", std::move(phases)},
+      // The loop, the intervals and the snapshots.
+      {"unattributed_seconds", seconds - attributedSeconds},
+  };
+}
+
+/**
+ * Returns the statistics of the intervals of a simulation.
+ */
+static std::vector<json> IntervalsJson(const SimArgs& args,
+                                       const detail::SimStats& stats,
+                                       int64_t metricInstr) {
+  int64_t endInstr = args.warmupInstrs + metricInstr;
+  std::vector<json> intervalsJson;
+  intervalsJson.reserve(stats.intervals.size());
+  for (const detail::IntervalStats& interval : stats.intervals) {
+    json j = IntervalJson(interval, args.intervalInstrs, endInstr);
+    if (!j.is_null()) intervalsJson.emplace_back(std::move(j));
+  }
+  return intervalsJson;
+}
+
+/**
+ * Returns the 64-bit FNV-1a hash of a string.
+ *
+ * Unlike std::hash, it does not change between builds,
+ * so it can name files that outlive the program.
+ */
+static uint64_t Fnv1a(const char* data, size_t size,
+                      uint64_t hash = 0xCBF29CE484222325ULL) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+static uint64_t Fnv1a(const std::string& str) {
+  return Fnv1a(str.data(), str.size());
+}
+
+/**
+ * Returns a hash in hexadecimal.
+ */
+static std::string HexHash(uint64_t hash) {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return hex;
+}
+
+/**
+ * Returns the name of a file made of a hash and an extension.
+ */
+static std::string HashFileName(uint64_t hash, const std::string& extension) {
+  return HexHash(hash) + "." + extension;
+}
+
+/**
+ * Writes a file through a temporary file,
+ * so that concurrent simulations never read a partial file.
+ */
+static void WriteFileAtomically(
+    const std::string& path, const std::function<void(std::ostream&)>& write) {
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path());
+  std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream os(tmpPath, std::ios::binary);
+    write(os);
+    if (!os.flush()) {
+      throw std::runtime_error("Simulate: cannot write '" + tmpPath + "'");
+    }
+  }
+  std::filesystem::rename(tmpPath, path);
+}
+
+detail::WarmupSnapshot::WarmupSnapshot(const SimArgs& args,
+                                       const SbbtReader& trace,
+                                       const json& metadata) {
+  if (args.snapshotDir.empty() || args.warmupInstrs == 0) return;
+  // The header of the trace tells apart different traces with the same path.
+  json key = {
+      {"trace", std::filesystem::absolute(args.tracepath).string()},
+      {"num_instructions", trace.numInstructions()},
+      {"num_branches", trace.numBranches()},
+      {"warmup_instr", args.warmupInstrs},
+      {"predictor", metadata},
+  };
+  key_ = key.dump();
+  path_ = (std::filesystem::path(args.snapshotDir) /
+           HashFileName(Fnv1a(key_), "snapshot"))
+              .string();
+}
+
+bool detail::WarmupSnapshot::load(Predictor& predictor) const {
+  std::ifstream is(path_, std::ios::binary);
+  if (!is) return false;
+  // A different key means a collision of the hashes.
+  std::vector<char> key;
+  Deserialize(is, key);
+  if (std::string(key.begin(), key.end()) != key_) return false;
+  predictor.deserialize(is);
+  return true;
+}
+
+void detail::WarmupSnapshot::save(const Predictor& predictor) const {
+  WriteFileAtomically(path_, [&](std::ostream& os) {
+    Serialize(os, std::vector<char>(key_.begin(), key_.end()));
+    predictor.serialize(os);
+  });
+}
+
+/**
+ * Returns the hash of the contents of a trace file, in hexadecimal.
+ *
+ * Hashing a large trace takes a while, so the hash is stored in dir
+ * along with the size and modification time of the file,
+ * and reused while they do not change.
+ */
+static std::string TraceDigest(const std::string& tracepath,
+                               const std::filesystem::path& dir) {
+  std::string abspath = std::filesystem::absolute(tracepath).string();
+  json stamp = {
+      {"trace", abspath},
+      {"size", std::filesystem::file_size(tracepath)},
+      {"mtime", std::filesystem::last_write_time(tracepath)
+                    .time_since_epoch()
+                    .count()},
+  };
+  std::string digestPath =
+      (dir / HashFileName(Fnv1a(abspath), "digest")).string();
+  std::ifstream is(digestPath);
+  if (is) {
+    json stored = json::parse(is, nullptr, false);
+    if (stored.is_object() && stored["stamp"] == stamp) {
+      return stored["digest"];
+    }
+  }
+
+  std::ifstream trace(tracepath, std::ios::binary);
+  if (!trace) {
+    throw std::runtime_error("Simulate: cannot read trace '" + tracepath + "'");
+  }
+  std::vector<char> buffer(1 << 20);
+  uint64_t hash = Fnv1a(nullptr, 0);
+  while (trace) {
+    trace.read(buffer.data(), buffer.size());
+    hash = Fnv1a(buffer.data(), trace.gcount(), hash);
+  }
+  std::string digest = HexHash(hash);
+  WriteFileAtomically(digestPath, [&](std::ostream& os) {
+    os << json{{"stamp", stamp}, {"digest", digest}};
+  });
+  return digest;
+}
+
+detail::ResultCache::ResultCache(const SimArgs& args, const SbbtReader& trace,
+                                 const json& metadata)
+    : tracepath_(args.tracepath) {
+  if (args.cacheDir.empty()) return;
+  // The path of the trace is not part of the key,
+  // so copies of a trace share their outputs.
+  json key = {
+      {"trace_digest", TraceDigest(args.tracepath, args.cacheDir)},
+      {"num_instructions", trace.numInstructions()},
+      {"num_branches", trace.numBranches()},
+      {"warmup_instr", args.warmupInstrs},
+      {"simulation_instr", args.simInstr},
+      {"interval_instr", args.intervalInstrs},
+      {"profile_period", args.profilePeriod},
+      {"host_counters", args.hostCounters},
+      {"predictor", metadata},
+      {"tag", args.cacheTag},
+  };
+  key_ = key.dump();
+  path_ = (std::filesystem::path(args.cacheDir) /
+           HashFileName(Fnv1a(key_), "json"))
+              .string();
+}
+
+json detail::ResultCache::load() const {
+  std::ifstream is(path_);
+  if (!is) return nullptr;
+  json stored = json::parse(is, nullptr, false);
+  // A different key means a collision of the hashes.
+  if (!stored.is_object() || stored["key"] != key_) return nullptr;
+  json output = std::move(stored["output"]);
+  output["metadata"]["trace"] = tracepath_;
+  return output;
+}
+
+void detail::ResultCache::save(const json& output) const {
+  WriteFileAtomically(path_, [&](std::ostream& os) {
+    os << json{{"key", key_}, {"output", output}};
+  });
+}
+
+/**
+ * Returns the number of instructions used to compute the metrics
+ * and adds an error to errors if the trace was too short.
+ */
+int64_t detail::MetricInstr(const SimArgs& args, const TraceRun& run,
+                            std::vector<std::string>& errors) {
+  if (args.simInstr != 0 && run.exhaustedTrace) {
     std::string errMsg = "The trace did not contain " +
-                         std::to_string(simInstr) + " instructions, only " +
-                         std::to_string(trace.lastInstrRead());
+                         std::to_string(args.simInstr) +
+                         " instructions, only " +
+                         std::to_string(run.lastInstrRead);
     errors.emplace_back(errMsg);
   }
+  // See Note 0.
+  return args.simInstr == 0 ? run.numInstructions - args.warmupInstrs
+                            : args.simInstr;
+}
 
-  // Most failed branches are defined as those
-  // that together account for 1/2 of the mispredictions.
-  std::vector<std::pair<uint64_t, BranchInfo>> mostFailed(branchInfo.begin(),
-                                                          branchInfo.end());
+/**
+ * Returns the pairs of ip and statistics of the branches
+ * recorded in stats, given the ip of each static branch identifier.
+ */
+static std::vector<std::pair<uint64_t, detail::BranchInfo>> BranchInfoByIp(
+    const detail::SimStats& stats, const std::vector<uint64_t>& staticIps) {
+  std::vector<std::pair<uint64_t, detail::BranchInfo>> branches;
+  stats.branchInfo.forEach(
+      staticIps, [&](uint64_t ip, const detail::BranchInfo& inf) {
+        if (inf.occurrences != 0) branches.emplace_back(ip, inf);
+      });
+  return branches;
+}
+
+/**
+ * Returns the most failed branches,
+ * defined as those that together account for 1/2 of the mispredictions.
+ */
+static std::vector<json> MostFailedJson(
+    std::vector<std::pair<uint64_t, detail::BranchInfo>> mostFailed,
+    int64_t mispredictions, int64_t metricInstr) {
   sort(mostFailed.begin(), mostFailed.end(),
        [](const auto& lhs, const auto& rhs) {
-         return lhs.second.misses > rhs.second.misses;
+         // Ties are broken by address, so that the order is deterministic.
+         if (lhs.second.misses != rhs.second.misses) {
+           return lhs.second.misses > rhs.second.misses;
+         }
+         return lhs.first < rhs.first;
        });
   size_t keepidx = 0;
-  size_t lastidx = std::min(mostFailed.size(), MAX_NUM_LISTED_BRANCHES);
+  size_t lastidx =
+      std::min(mostFailed.size(), detail::MAX_NUM_LISTED_BRANCHES);
   for (int64_t keepsum = 0; keepidx < lastidx; ++keepidx) {
     if (2 * keepsum >= mispredictions) break;
     keepsum += mostFailed[keepidx].second.misses;
@@ -133,84 +566,369 @@ json Simulate(Predictor* branchPredictor, const SimArgs& args) {
     };
     halfMispredictionsJson.emplace_back(std::move(j));
   }
+  return halfMispredictionsJson;
+}
+
+json detail::SimulateReport(const SimArgs& args, const TraceRun& run,
+                            const SimStats& stats, json metadata,
+                            json executionStats) {
+  std::vector<std::string> errors;
+  int64_t metricInstr = detail::MetricInstr(args, run, errors);
+  auto branches = BranchInfoByIp(stats, run.staticIps);
+  size_t numBranchInstructions = branches.size();
+  std::vector<json> halfMispredictionsJson =
+      MostFailedJson(std::move(branches), stats.mispredictions, metricInstr);
 
   json j = {
       {"metadata",
        {
            {"simulator", "MBPlib simulate"},
            {"simulator_version", "v0.6.0"},
-           {"trace", tracepath},
-           {"warmup_instr", warmupInstrs},
+           {"trace", args.tracepath},
+           {"warmup_instr", args.warmupInstrs},
            {"simulation_instr", metricInstr},
-           {"exhausted_trace", trace.eof()},
-           {"num_conditonal_branches", numBranches},
-           {"num_branch_instructions", branchInfo.size()},
-           {"predictor", branchPredictor->metadata_stats()},
+           {"exhausted_trace", run.exhaustedTrace},
+           {"num_conditonal_branches", stats.numBranches},
+           {"num_branch_instructions", numBranchInstructions},
+           {"predictor", std::move(metadata)},
        }},
       {"metrics",
        {
-           {"mpki", 1000.0 * mispredictions / metricInstr},
-           {"mispredictions", mispredictions},
-           {"accuracy",
-            static_cast<double>(numBranches - mispredictions) / numBranches},
-           {"simulation_time", simulationTime},
-           {"num_most_failed_branches", mostFailed.size()},
+           {"mpki", 1000.0 * stats.mispredictions / metricInstr},
+           {"mispredictions", stats.mispredictions},
+           {"accuracy", static_cast<double>(stats.numBranches -
+                                            stats.mispredictions) /
+                            stats.numBranches},
+           {"simulation_time", run.simulationTime},
+           {"num_most_failed_branches", halfMispredictionsJson.size()},
        }},
-      {"predictor_statistics", branchPredictor->execution_stats()},
+      {"predictor_statistics", std::move(executionStats)},
       {"most_failed", halfMispredictionsJson},
       {"errors", errors},
   };
+  // Intervals passed to the sink are only kept to be cached.
+  if (args.intervalInstrs != 0 &&
+      (!args.intervalSink || !args.cacheDir.empty())) {
+    j["intervals"] = IntervalsJson(args, stats, metricInstr);
+  }
   return j;
 }
 
-json ParallelSim(const std::vector<Predictor*>& predictor,
-                 const SimArgs& args) {
-  const auto& [tracepath, warmupInstrs, simInstr, stopAtInstr] = args;
-  SbbtReader trace{tracepath};
-  int64_t numBranches = 0;
-  std::vector<int64_t> mispredictions(predictor.size());
-  std::vector<std::string> errors;
+json Simulate(Predictor* branchPredictor, const SimArgs& args) {
+  return Simulate(*branchPredictor, args);
+}
+
+json SegmentedSimulate(const PredictorFactory& makePredictor,
+                       const SimArgs& args, int numSegments,
+                       int64_t warmupOverlap) {
+  if (numSegments < 1) {
+    throw std::invalid_argument("SegmentedSimulate: numSegments must be >= 1");
+  }
+  int64_t numInstructions = SbbtReader{args.tracepath}.numInstructions();
+  int64_t endInstr = args.simInstr == 0 ? numInstructions : args.stopAtInstr;
+  struct Segment {
+    int64_t warmupStart, start, stop;
+    std::unique_ptr<Predictor> predictor;
+    detail::SimStats stats;
+    // The identifiers of each segment come from its own reader.
+    std::vector<uint64_t> staticIps;
+    bool exhaustedTrace;
+    int64_t lastInstrRead;
+    std::exception_ptr error;
+  };
+  std::vector<Segment> segments(numSegments);
+  auto segmentStart = [&](int i) {
+    return args.warmupInstrs +
+           (endInstr - args.warmupInstrs) * i / numSegments;
+  };
+  for (int i = 0; i < numSegments; ++i) {
+    Segment& segment = segments[i];
+    segment.start = segmentStart(i);
+    segment.stop =
+        i + 1 == numSegments ? args.stopAtInstr : segmentStart(i + 1);
+    // The first segment is warmed up like in Simulate.
+    segment.warmupStart =
+        i == 0 ? 0 : std::max<int64_t>(0, segment.start - warmupOverlap);
+    segment.predictor = makePredictor();
+  }
 
   auto startTime = std::chrono::high_resolution_clock::now();
-  Branch b;
-  int64_t instrNum = 0;
-  while ((instrNum = trace.nextBranch(b)) < stopAtInstr) {
-    if (b.isConditional()) {
-      if (instrNum >= warmupInstrs) {
-        numBranches += 1;
+  std::vector<std::thread> workers;
+  workers.reserve(numSegments);
+  for (Segment& segment : segments) {
+    workers.emplace_back([&segment, &args] {
+      try {
+        SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+        segment.stats.branchInfo =
+            detail::BranchTable<detail::BranchInfo>(trace);
+        trace.seek(segment.warmupStart);
+        segment.exhaustedTrace =
+            detail::SimulateBranches(*segment.predictor, trace, segment.start,
+                                     segment.stop, segment.stats);
+        segment.staticIps = trace.staticIps();
+        segment.lastInstrRead = trace.lastInstrRead();
+      } catch (...) {
+        segment.error = std::current_exception();
       }
-      for (size_t i = 0; i < predictor.size(); ++i) {
-        bool predictedTaken = predictor[i]->predict(b.ip());
-        predictor[i]->train(b);
-        predictor[i]->track(b);
-        if (instrNum >= warmupInstrs) {
-          mispredictions[i] += predictedTaken != b.isTaken();
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+  for (Segment& segment : segments) {
+    if (segment.error) std::rethrow_exception(segment.error);
+  }
+  auto endTime = std::chrono::high_resolution_clock::now();
+  double simulationTime =
+      std::chrono::duration<double>(endTime - startTime).count();
+
+  detail::SimStats stats;
+  IpTable<detail::BranchInfo> branchInfo;
+  std::vector<json> segmentsJson;
+  std::vector<json> executionStats;
+  for (const Segment& segment : segments) {
+    stats.numBranches += segment.stats.numBranches;
+    stats.mispredictions += segment.stats.mispredictions;
+    for (const auto& [ip, inf] :
+         BranchInfoByIp(segment.stats, segment.staticIps)) {
+      branchInfo[ip].occurrences += inf.occurrences;
+      branchInfo[ip].misses += inf.misses;
+    }
+    segmentsJson.push_back({
+        {"warmup_start_instr", segment.warmupStart},
+        {"start_instr", segment.start},
+        {"num_conditonal_branches", segment.stats.numBranches},
+        {"mispredictions", segment.stats.mispredictions},
+    });
+    executionStats.emplace_back(segment.predictor->execution_stats());
+  }
+  // Only the last segment can reach the end of the trace.
+  detail::TraceRun run{numInstructions, segments.back().lastInstrRead,
+                       segments.back().exhaustedTrace, simulationTime};
+  std::vector<std::string> errors;
+  int64_t metricInstr = detail::MetricInstr(args, run, errors);
+  std::vector<std::pair<uint64_t, detail::BranchInfo>> branches;
+  branches.reserve(branchInfo.size());
+  for (const auto& [ip, inf] : branchInfo) branches.emplace_back(ip, inf);
+  std::vector<json> halfMispredictionsJson =
+      MostFailedJson(std::move(branches), stats.mispredictions, metricInstr);
+
+  json j = {
+      {"metadata",
+       {
+           {"simulator", "MBPlib segmented simulate"},
+           {"simulator_version", "v0.1.0"},
+           {"trace", args.tracepath},
+           {"warmup_instr", args.warmupInstrs},
+           {"simulation_instr", metricInstr},
+           {"num_segments", numSegments},
+           {"warmup_overlap", warmupOverlap},
+           {"exhausted_trace", run.exhaustedTrace},
+           {"num_conditonal_branches", stats.numBranches},
+           {"num_branch_instructions", branchInfo.size()},
+           {"predictor", segments.front().predictor->metadata_stats()},
+       }},
+      {"metrics",
+       {
+           {"mpki", 1000.0 * stats.mispredictions / metricInstr},
+           {"mispredictions", stats.mispredictions},
+           {"accuracy", static_cast<double>(stats.numBranches -
+                                            stats.mispredictions) /
+                            stats.numBranches},
+           {"simulation_time", simulationTime},
+           {"num_most_failed_branches", halfMispredictionsJson.size()},
+       }},
+      {"segments", segmentsJson},
+      {"predictor_statistics", executionStats},
+      {"most_failed", halfMispredictionsJson},
+      {"errors", errors},
+  };
+  return j;
+}
+
+namespace {
+
+/**
+ * Ring of chunks of decoded branches,
+ * written by one producer and read by several consumers.
+ *
+ * The chunks are numbered in order and chunk seq is stored in slot
+ * seq % NUM_SLOTS. The producer reuses a slot once all the consumers
+ * have released the chunk stored in it.
+ * Synchronization only uses atomics: a thread waiting for a slot
+ * spins for a while and then yields the processor until it is ready.
+ */
+class BranchChunkRing {
+ public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+  static constexpr size_t NUM_SLOTS = 8;
+
+  struct Chunk {
+    std::array<uint64_t, CHUNK_SIZE> ip, target;
+    std::array<uint8_t, CHUNK_SIZE> opcode, outcome;
+    std::array<int64_t, CHUNK_SIZE> instrNum;
+    std::array<uint32_t, CHUNK_SIZE> staticId;
+    // Number of branches. An empty chunk ends the stream.
+    size_t size;
+
+    BranchArrays arrays() {
+      return {ip.data(), target.data(), opcode.data(), outcome.data(),
+              instrNum.data(), staticId.data()};
+    }
+  };
+
+  BranchChunkRing(int numConsumers)
+      : slots_(new Slot[NUM_SLOTS]), numConsumers_(numConsumers) {}
+
+  /**
+   * Returns the slot where the producer must write chunk seq.
+   */
+  Chunk& acquire(int64_t seq) {
+    Slot& slot = slots_[seq % NUM_SLOTS];
+    WaitUntil(
+        [&] { return slot.pending.load(std::memory_order_acquire) == 0; });
+    return slot.chunk;
+  }
+
+  /**
+   * Makes chunk seq, previously acquired, visible to the consumers.
+   */
+  void publish(int64_t seq) {
+    Slot& slot = slots_[seq % NUM_SLOTS];
+    slot.pending.store(numConsumers_, std::memory_order_relaxed);
+    slot.published.store(seq, std::memory_order_release);
+  }
+
+  /**
+   * Waits until chunk seq is published and returns it.
+   */
+  const Chunk& wait(int64_t seq) {
+    Slot& slot = slots_[seq % NUM_SLOTS];
+    WaitUntil(
+        [&] { return slot.published.load(std::memory_order_acquire) == seq; });
+    return slot.chunk;
+  }
+
+  /**
+   * Tells that a consumer has finished reading chunk seq.
+   */
+  void release(int64_t seq) {
+    slots_[seq % NUM_SLOTS].pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+ private:
+  struct Slot {
+    Chunk chunk;
+    // The atomics are kept in their own cache line.
+    alignas(64) std::atomic<int64_t> published{-1};
+    std::atomic<int> pending{0};
+  };
+
+  template <typename F>
+  static void WaitUntil(F&& ready) {
+    constexpr int SPINS_BEFORE_YIELD = 64;
+    for (int spins = 0; !ready(); ++spins) {
+      if (spins >= SPINS_BEFORE_YIELD) std::this_thread::yield();
+    }
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  int numConsumers_;
+};
+
+}  // namespace
+
+/**
+ * The calling thread decodes the trace into a BranchChunkRing
+ * and each of the threads simulates every numThreads-th predictor.
+ */
+bool detail::ParallelForEachChunk(
+    SbbtReader& trace, int64_t warmupInstrs, int64_t stopAtInstr,
+    size_t numPredictors, int numThreads, int64_t& numBranches,
+    const std::function<void(size_t, const BranchArrays&, size_t)>&
+        simulateChunk) {
+  using Chunk = BranchChunkRing::Chunk;
+  numThreads = std::min<size_t>(numThreads, numPredictors);
+  BranchChunkRing ring(numThreads);
+  std::vector<std::exception_ptr> errors(numThreads);
+  std::vector<std::thread> workers;
+  workers.reserve(numThreads);
+  for (int t = 0; t < numThreads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int64_t seq = 0;; ++seq) {
+        const Chunk& chunk = ring.wait(seq);
+        if (chunk.size == 0) break;
+        // After an error, the chunks are still released
+        // so that the producer can finish.
+        if (!errors[t]) {
+          try {
+            // The consumers only read the arrays.
+            BranchArrays arrays = const_cast<Chunk&>(chunk).arrays();
+            for (size_t i = t; i < numPredictors; i += numThreads) {
+              simulateChunk(i, arrays, chunk.size);
+            }
+          } catch (...) {
+            errors[t] = std::current_exception();
+          }
         }
+        ring.release(seq);
       }
-    } else {
-      for (size_t i = 0; i < predictor.size(); ++i) {
-        predictor[i]->track(b);
+    });
+  }
+
+  bool exhaustedTrace = true;
+  int64_t seq = 0;
+  std::exception_ptr producerError;
+  try {
+    bool stopped = false;
+    while (true) {
+      Chunk& chunk = ring.acquire(seq);
+      size_t n = stopped ? 0
+                         : trace.nextBranches(chunk.arrays(),
+                                              BranchChunkRing::CHUNK_SIZE);
+      auto instrNumEnd = chunk.instrNum.begin() + n;
+      size_t size =
+          std::lower_bound(chunk.instrNum.begin(), instrNumEnd, stopAtInstr) -
+          chunk.instrNum.begin();
+      if (size < n) {
+        exhaustedTrace = false;
+        stopped = true;
+      }
+      for (size_t j = 0; j < size; ++j) {
+        Branch b{chunk.ip[j], chunk.target[j],
+                 static_cast<Branch::OpCode>(chunk.opcode[j]),
+                 chunk.outcome[j]};
+        numBranches += b.isConditional() && chunk.instrNum[j] >= warmupInstrs;
       }
+      chunk.size = size;
+      ring.publish(seq++);
+      if (size == 0) break;
     }
+  } catch (...) {
+    producerError = std::current_exception();
+    // Stop the workers with an empty chunk.
+    ring.acquire(seq).size = 0;
+    ring.publish(seq);
   }
-  auto endTime = std::chrono::high_resolution_clock::now();
-  double simulationTime =
-      std::chrono::duration<double>(endTime - startTime).count();
-  // See Note 0.
-  int64_t metricInstr =
-      simInstr == 0 ? trace.numInstructions() - warmupInstrs : simInstr;
-  if (simInstr != 0 && trace.eof()) {
-    std::string errMsg = "The trace did not contain " +
-                         std::to_string(simInstr) + " instructions, only " +
-                         std::to_string(trace.lastInstrRead());
-    errors.emplace_back(errMsg);
+  for (std::thread& worker : workers) worker.join();
+  if (producerError) std::rethrow_exception(producerError);
+  for (const auto& error : errors) {
+    if (error) std::rethrow_exception(error);
   }
+  return exhaustedTrace;
+}
+
+json detail::ParallelSimReport(const SimArgs& args, const TraceRun& run,
+                               int64_t numBranches,
+                               const std::vector<int64_t>& mispredictions,
+                               std::vector<json> metadata,
+                               std::vector<json> executionStats) {
+  std::vector<std::string> errors;
+  int64_t metricInstr = detail::MetricInstr(args, run, errors);
 
   std::vector<json> results;
-  results.reserve(predictor.size());
-  for (size_t i = 0; i < predictor.size(); ++i) {
+  results.reserve(mispredictions.size());
+  for (size_t i = 0; i < mispredictions.size(); ++i) {
     json j = {
-        {"predictor", predictor[i]->metadata_stats()},
+        {"predictor", std::move(metadata[i])},
         {"metrics",
          {
              {"mpki", 1000.0 * mispredictions[i] / metricInstr},
@@ -218,7 +936,7 @@ json ParallelSim(const std::vector<Predictor*>& predictor,
              {"accuracy", static_cast<double>(numBranches - mispredictions[i]) /
                               numBranches},
          }},
-        {"predictor_statistics", predictor[i]->execution_stats()},
+        {"predictor_statistics", std::move(executionStats[i])},
     };
     results.emplace_back(std::move(j));
   }
@@ -227,62 +945,79 @@ json ParallelSim(const std::vector<Predictor*>& predictor,
        {
            {"simulator", "MBPlib parallel simulate"},
            {"simulator_version", "v0.1.0"},
-           {"trace", tracepath},
-           {"warmup_instr", warmupInstrs},
+           {"trace", args.tracepath},
+           {"warmup_instr", args.warmupInstrs},
            {"simulation_instr", metricInstr},
-           {"exhausted_trace", trace.eof()},
+           {"exhausted_trace", run.exhaustedTrace},
            {"num_conditonal_branches", numBranches},
        }},
-      {"simulation_time", simulationTime},
+      {"simulation_time", run.simulationTime},
       {"results", results},
       {"errors", errors},
   };
   return j;
 }
 
-json Compare(std::array<Predictor*, 2> predictor, const SimArgs& args) {
-  const auto& [tracepath, warmupInstrs, simInstr, stopAtInstr] = args;
-  SbbtReader trace{tracepath};
-  using BranchInfo = std::array<int64_t, 4>;
-  std::unordered_map<uint64_t, BranchInfo> branchInfo;
-  std::vector<std::string> errors;
+json ParallelSim(const std::vector<Predictor*>& predictor,
+                 const SimArgs& args) {
+  SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+  int64_t numBranches = 0;
+  std::vector<int64_t> mispredictions(predictor.size());
 
+  detail::HostCounters hostCounters(args.hostCounters);
   auto startTime = std::chrono::high_resolution_clock::now();
-  Branch b;
-  int64_t instrNum = 0;
-  while ((instrNum = trace.nextBranch(b)) < stopAtInstr) {
-    if (b.isConditional()) {
-      std::array<bool, 2> pred = {
-          predictor[0]->predict(b.ip()),
-          predictor[1]->predict(b.ip()),
-      };
-      predictor[0]->train(b);
-      predictor[1]->train(b);
-      if (instrNum >= warmupInstrs) {
-        std::array<int, 2> wasMisp = {pred[0] != b.isTaken(),
-                                      pred[1] != b.isTaken()};
-        int index = (wasMisp[1] << 1) | wasMisp[0];
-        branchInfo[b.ip()][index] += 1;
-      }
-    }
-    predictor[0]->track(b);
-    predictor[1]->track(b);
+  hostCounters.start();
+  bool exhaustedTrace;
+  if (args.threads > 1 && predictor.size() > 1) {
+    exhaustedTrace = detail::ParallelForEachChunk(
+        trace, args.warmupInstrs, args.stopAtInstr, predictor.size(),
+        args.threads, numBranches,
+        [&](size_t i, const BranchArrays& chunk, size_t size) {
+          mispredictions[i] += detail::SimulateChunk(*predictor[i], chunk,
+                                                     size, args.warmupInstrs);
+        });
+  } else {
+    exhaustedTrace = detail::ForEachBranch(
+        trace, args.stopAtInstr, [&](const Branch& b, int64_t instrNum) {
+          bool measured = b.isConditional() && instrNum >= args.warmupInstrs;
+          numBranches += measured;
+          for (size_t i = 0; i < predictor.size(); ++i) {
+            mispredictions[i] +=
+                detail::SimulateBranch(*predictor[i], b) && measured;
+          }
+        });
   }
-  auto endTime = std::chrono::high_resolution_clock::now();
-  double simulationTime =
-      std::chrono::duration<double>(endTime - startTime).count();
-  // See Note 0.
-  int64_t metricInstr =
-      simInstr == 0 ? trace.numInstructions() - warmupInstrs : simInstr;
-  if (simInstr != 0 && trace.eof()) {
-    std::string errMsg = "The trace did not contain " +
-                         std::to_string(simInstr) + " instructions, only " +
-                         std::to_string(trace.lastInstrRead());
-    errors.emplace_back(errMsg);
+  hostCounters.stop();
+  detail::TraceRun run = detail::EndTraceRun(trace, exhaustedTrace, startTime);
+  std::vector<json> metadata, executionStats;
+  for (const Predictor* p : predictor) {
+    metadata.emplace_back(p->metadata_stats());
+    executionStats.emplace_back(p->execution_stats());
   }
+  json output = detail::ParallelSimReport(args, run, numBranches,
+                                          mispredictions, std::move(metadata),
+                                          std::move(executionStats));
+  if (args.hostCounters) {
+    // The trace is read in chunks, which can go past stopAtInstr,
+    // and the simulation starts at the beginning of the trace.
+    output["host_counters"] =
+        hostCounters.report(std::min(run.lastInstrRead, args.stopAtInstr));
+  }
+  return output;
+}
 
-  std::vector<std::pair<uint64_t, BranchInfo>> simInfo(branchInfo.begin(),
-                                                       branchInfo.end());
+json detail::CompareReport(const SimArgs& args, const TraceRun& run,
+                           const BranchTable<CompareInfo>& branchInfo,
+                           std::array<json, 2> metadata,
+                           std::array<json, 2> executionStats) {
+  std::vector<std::string> errors;
+  int64_t metricInstr = detail::MetricInstr(args, run, errors);
+
+  std::vector<std::pair<uint64_t, CompareInfo>> simInfo;
+  branchInfo.forEach(run.staticIps, [&](uint64_t ip, const CompareInfo& info) {
+    if (info != CompareInfo{}) simInfo.emplace_back(ip, info);
+  });
+  size_t numBranchInstructions = simInfo.size();
   int64_t numBranches = 0;
   std::array<int64_t, 2> mispredictions = {0, 0};
   int64_t mispredictionsDiff = 0;
@@ -296,8 +1031,11 @@ json Compare(std::array<Predictor*, 2> predictor, const SimArgs& args) {
   // that together account for 1/2 of the mpki difference.
   std::vector<json> mostFailedJson;
   sort(simInfo.begin(), simInfo.end(), [](const auto& lhs, const auto& rhs) {
-    return std::abs(lhs.second[0b10] - lhs.second[0b01]) >
-           std::abs(rhs.second[0b10] - rhs.second[0b01]);
+    int64_t lhsDiff = std::abs(lhs.second[0b10] - lhs.second[0b01]);
+    int64_t rhsDiff = std::abs(rhs.second[0b10] - rhs.second[0b01]);
+    // Ties are broken by address, so that the order is deterministic.
+    if (lhsDiff != rhsDiff) return lhsDiff > rhsDiff;
+    return lhs.first < rhs.first;
   });
   size_t keepidx = 0;
   size_t lastidx = std::min(simInfo.size(), MAX_NUM_LISTED_BRANCHES);
@@ -325,17 +1063,13 @@ json Compare(std::array<Predictor*, 2> predictor, const SimArgs& args) {
        {
            {"simulator", "MBPlib compare"},
            {"simulator_version", "v0.1.0"},
-           {"trace", tracepath},
-           {"warmup_instr", warmupInstrs},
+           {"trace", args.tracepath},
+           {"warmup_instr", args.warmupInstrs},
            {"simulation_instr", metricInstr},
-           {"exhausted_trace", trace.eof()},
+           {"exhausted_trace", run.exhaustedTrace},
            {"num_conditonal_branches", numBranches},
-           {"num_branch_instructions", branchInfo.size()},
-           {"predictors",
-            {
-                predictor[0]->metadata_stats(),
-                predictor[1]->metadata_stats(),
-            }},
+           {"num_branch_instructions", numBranchInstructions},
+           {"predictors", std::move(metadata)},
        }},
       {"metrics",
        {
@@ -346,31 +1080,84 @@ json Compare(std::array<Predictor*, 2> predictor, const SimArgs& args) {
             }},
            {"mpki_difference", 1000.0 * mispredictionsDiff / metricInstr},
            {"mispredictions", mispredictions},
-           {"simulation_time", simulationTime},
+           {"simulation_time", run.simulationTime},
            {"num_most_failed_branches", simInfo.size()},
        }},
-      {"predictor_statistics",
-       {
-           predictor[0]->execution_stats(),
-           predictor[1]->execution_stats(),
-       }},
+      {"predictor_statistics", std::move(executionStats)},
       {"most_failed", mostFailedJson},
       {"errors", errors},
   };
   return j;
 }
 
-int SimMain(int argc, char** argv, Predictor* branchPredictor) {
-  json output = Simulate(branchPredictor, ParseCmdLineArgs(argc, argv));
-  std::cout << std::setw(2) << output << std::endl;
+json Compare(std::array<Predictor*, 2> predictor, const SimArgs& args) {
+  return Compare(*predictor[0], *predictor[1], args);
+}
+
+json detail::SendCachedIntervals(const SimArgs& args, json output) {
+  if (args.intervalSink && output.contains("intervals")) {
+    for (const json& interval : output["intervals"]) {
+      args.intervalSink(interval);
+    }
+    output.erase("intervals");
+  }
+  return output;
+}
+
+int detail::PrintReport(const json& output, const SimArgs& args) {
+  WriteReport(std::cout, output, args.outputFormat);
+  std::cout.flush();
   return output["errors"].empty() ? 0 : ERR_SIMULATION_ERROR;
 }
 
+void detail::PrintIntervalsAsTheyEnd(SimArgs& args) {
+  if (args.outputFormat == OutputFormat::JSON) return;
+  args.intervalSink = [format = args.outputFormat](const json& interval) {
+    WriteRecord(std::cout, "intervals", interval, format);
+    std::cout.flush();
+  };
+}
+
+int SimMain(int argc, char** argv, Predictor* branchPredictor) {
+  SimArgs args = ParseCmdLineArgs(argc, argv);
+  detail::PrintIntervalsAsTheyEnd(args);
+  return detail::PrintReport(Simulate(branchPredictor, args), args);
+}
+
+int SegmentedSimMain(int argc, char** argv,
+                     const PredictorFactory& makePredictor) {
+  int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+  int numSegments = hardwareThreads;
+  int64_t warmupOverlap = DEFAULT_WARMUP_OVERLAP;
+  // Remove the options of the segmented simulation
+  // before parsing the common ones.
+  std::vector<char*> commonArgs;
+  for (int i = 0; i < argc; ++i) {
+    char* endptr;
+    if (strncmp(argv[i], "--segments=", 11) == 0) {
+      // Each segment has its own predictor and thread.
+      numSegments = ParsePositiveOption(
+          "--segments", argv[i] + 11,
+          static_cast<int64_t>(hardwareThreads) * MAX_SEGMENTS_PER_THREAD);
+    } else if (strncmp(argv[i], "--warmup-overlap=", 17) == 0) {
+      warmupOverlap = strtoll(argv[i] + 17, &endptr, 0);
+      if (*endptr != '\0' || warmupOverlap < 0) {
+        std::cerr << "--warmup-overlap must be a non-negative integer\n";
+        return ERR_INPUT_DATA;
+      }
+    } else {
+      commonArgs.push_back(argv[i]);
+    }
+  }
+  SimArgs args = ParseCmdLineArgs(commonArgs.size(), commonArgs.data());
+  return detail::PrintReport(
+      SegmentedSimulate(makePredictor, args, numSegments, warmupOverlap),
+      args);
+}
+
 int CompareMain(int argc, char** argv,
                 std::array<Predictor*, 2> comparedPredictors) {
-  auto args = ParseCmdLineArgs(argc, argv);
-  mbp::json output = mbp::Compare(comparedPredictors, args);
-  std::cout << std::setw(2) << output << std::endl;
-  return output["errors"].empty() ? 0 : ERR_SIMULATION_ERROR;
+  SimArgs args = ParseCmdLineArgs(argc, argv);
+  return detail::PrintReport(Compare(comparedPredictors, args), args);
 }
 }  // namespace mbp
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mbp/sim/sbbt_reader.hpp"
+#include "mbp/sim/simulator.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+namespace {
+
+/**
+ * State of a candidate of SuccessiveHalving.
+ */
+struct Candidate {
+  // Only while the candidate is simulated.
+  std::unique_ptr<Predictor> predictor;
+  int64_t mispredictions = 0;
+  // Rung in which it was eliminated, or -1 if it survived all of them.
+  int64_t eliminatedAtRung = -1;
+  // Conditional branches and instructions after the warmup
+  // that the candidate simulated.
+  int64_t numBranches = 0;
+  int64_t simulatedInstr = 0;
+  json metadata;
+  json executionStats;
+};
+
+}  // namespace
+
+/**
+ * Returns the end of a rung of the given length after the warmup,
+ * saturating instead of overflowing.
+ */
+static int64_t RungEnd(int64_t warmupInstrs, double rungLength) {
+  constexpr int64_t MAX_INSTR = std::numeric_limits<int64_t>::max();
+  if (rungLength >= static_cast<double>(MAX_INSTR - warmupInstrs)) {
+    return MAX_INSTR;
+  }
+  return warmupInstrs + static_cast<int64_t>(rungLength);
+}
+
+json SuccessiveHalving(const std::vector<PredictorFactory>& makeCandidates,
+                       const SimArgs& args, const HalvingOptions& options) {
+  if (options.firstRungInstrs <= 0) {
+    throw std::invalid_argument(
+        "SuccessiveHalving: the first rung must have instructions");
+  }
+  if (!(options.rungGrowth > 1)) {
+    throw std::invalid_argument(
+        "SuccessiveHalving: the rung growth must be greater than 1");
+  }
+  if (!(options.keepFraction > 0 && options.keepFraction <= 1)) {
+    throw std::invalid_argument(
+        "SuccessiveHalving: the kept fraction must be in (0, 1]");
+  }
+  if (options.minSurvivors < 1) {
+    throw std::invalid_argument(
+        "SuccessiveHalving: there must be at least one survivor");
+  }
+
+  std::vector<Candidate> candidates(makeCandidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    candidates[i].predictor = makeCandidates[i]();
+  }
+  std::vector<size_t> alive(candidates.size());
+  std::iota(alive.begin(), alive.end(), 0);
+
+  SbbtReader trace{args.tracepath, SbbtReaderOptions{args.prefetch}};
+  int64_t numBranches = 0;
+  std::vector<json> rungs;
+  double rungLength = options.firstRungInstrs;
+  int64_t rungEnd = RungEnd(args.warmupInstrs, rungLength);
+
+  // Keeps the best candidates of the rung that ends at rungEnd.
+  auto endRung = [&]() {
+    // The candidates with the same mispredictions keep their order.
+    std::stable_sort(alive.begin(), alive.end(), [&](size_t a, size_t b) {
+      return candidates[a].mispredictions < candidates[b].mispredictions;
+    });
+    size_t numSurvivors = std::max(
+        options.minSurvivors,
+        static_cast<size_t>(std::ceil(alive.size() * options.keepFraction)));
+    numSurvivors = std::min(numSurvivors, alive.size());
+    for (size_t k = numSurvivors; k < alive.size(); ++k) {
+      Candidate& candidate = candidates[alive[k]];
+      candidate.eliminatedAtRung = rungs.size();
+      candidate.numBranches = numBranches;
+      candidate.simulatedInstr = rungEnd - args.warmupInstrs;
+      candidate.metadata = candidate.predictor->metadata_stats();
+      candidate.executionStats = candidate.predictor->execution_stats();
+      candidate.predictor.reset();
+    }
+    rungs.push_back({
+        {"end_instr", rungEnd},
+        {"num_candidates", alive.size()},
+        {"survivors", numSurvivors},
+    });
+    alive.resize(numSurvivors);
+    std::sort(alive.begin(), alive.end());
+    rungLength *= options.rungGrowth;
+    rungEnd = RungEnd(args.warmupInstrs, rungLength);
+  };
+
+  std::array<uint64_t, detail::BATCH_SIZE> ip, target;
+  std::array<uint8_t, detail::BATCH_SIZE> opcode, outcome;
+  std::array<int64_t, detail::BATCH_SIZE> instrNum;
+  std::array<uint32_t, detail::BATCH_SIZE> staticId;
+  BranchArrays batch = {ip.data(), target.data(), opcode.data(),
+                        outcome.data(), instrNum.data(), staticId.data()};
+  auto startTime = std::chrono::high_resolution_clock::now();
+  bool exhaustedTrace = true;
+  size_t n;
+  while (exhaustedTrace &&
+         (n = trace.nextBranches(batch, detail::BATCH_SIZE)) != 0) {
+    // The batch is split at the ends of the rungs,
+    // where the worst candidates are eliminated.
+    size_t pos = 0;
+    while (pos < n) {
+      bool lastRung = alive.size() <= options.minSurvivors;
+      int64_t boundary =
+          lastRung ? args.stopAtInstr : std::min(rungEnd, args.stopAtInstr);
+      size_t end = std::lower_bound(instrNum.begin() + pos,
+                                    instrNum.begin() + n, boundary) -
+                   instrNum.begin();
+      BranchArrays chunk = {ip.data() + pos, target.data() + pos,
+                            opcode.data() + pos, outcome.data() + pos,
+                            instrNum.data() + pos, staticId.data() + pos};
+      for (size_t i : alive) {
+        candidates[i].mispredictions += detail::SimulateChunk(
+            *candidates[i].predictor, chunk, end - pos, args.warmupInstrs);
+      }
+      for (size_t j = pos; j < end; ++j) {
+        Branch b{ip[j], target[j], static_cast<Branch::OpCode>(opcode[j]),
+                 outcome[j]};
+        numBranches += b.isConditional() && instrNum[j] >= args.warmupInstrs;
+      }
+      pos = end;
+      if (pos == n) break;
+      if (boundary == args.stopAtInstr) {
+        exhaustedTrace = false;
+        break;
+      }
+      endRung();
+    }
+  }
+  detail::TraceRun run = detail::EndTraceRun(trace, exhaustedTrace, startTime);
+  std::vector<std::string> errors;
+  int64_t metricInstr = detail::MetricInstr(args, run, errors);
+  for (size_t i : alive) {
+    Candidate& candidate = candidates[i];
+    candidate.numBranches = numBranches;
+    candidate.simulatedInstr = metricInstr;
+    candidate.metadata = candidate.predictor->metadata_stats();
+    candidate.executionStats = candidate.predictor->execution_stats();
+    candidate.predictor.reset();
+  }
+
+  std::vector<json> results;
+  results.reserve(candidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    Candidate& candidate = candidates[i];
+    json eliminatedAtRung = nullptr;
+    if (candidate.eliminatedAtRung != -1) {
+      eliminatedAtRung = candidate.eliminatedAtRung;
+    }
+    json j = {
+        {"candidate", i},
+        {"predictor", std::move(candidate.metadata)},
+        {"eliminated_at_rung", eliminatedAtRung},
+        {"simulated_instr", candidate.simulatedInstr},
+        {"metrics",
+         {
+             {"mpki", 1000.0 * candidate.mispredictions /
+                          candidate.simulatedInstr},
+             {"mispredictions", candidate.mispredictions},
+             {"accuracy", static_cast<double>(candidate.numBranches -
+                                              candidate.mispredictions) /
+                              candidate.numBranches},
+         }},
+        {"predictor_statistics", std::move(candidate.executionStats)},
+    };
+    results.emplace_back(std::move(j));
+  }
+
+  // The candidates that went further are better,
+  // and those eliminated in the same rung are compared by their MPKI.
+  auto rungsSurvived = [&](const Candidate& candidate) {
+    return candidate.eliminatedAtRung == -1
+               ? static_cast<int64_t>(rungs.size())
+               : candidate.eliminatedAtRung;
+  };
+  std::vector<size_t> ranking(candidates.size());
+  std::iota(ranking.begin(), ranking.end(), 0);
+  std::stable_sort(ranking.begin(), ranking.end(), [&](size_t a, size_t b) {
+    int64_t rungsA = rungsSurvived(candidates[a]);
+    int64_t rungsB = rungsSurvived(candidates[b]);
+    if (rungsA != rungsB) return rungsA > rungsB;
+    return candidates[a].mispredictions < candidates[b].mispredictions;
+  });
+
+  json j = {
+      {"metadata",
+       {
+           {"simulator", "MBPlib successive halving"},
+           {"simulator_version", "v0.1.0"},
+           {"trace", args.tracepath},
+           {"warmup_instr", args.warmupInstrs},
+           {"simulation_instr", metricInstr},
+           {"exhausted_trace", run.exhaustedTrace},
+           {"num_candidates", candidates.size()},
+           {"first_rung_instr", options.firstRungInstrs},
+           {"rung_growth", options.rungGrowth},
+           {"keep_fraction", options.keepFraction},
+           {"min_survivors", options.minSurvivors},
+       }},
+      {"simulation_time", run.simulationTime},
+      {"rungs", rungs},
+      {"results", results},
+      {"ranking", ranking},
+      {"errors", errors},
+  };
+  return j;
+}
+
+int SuccessiveHalvingMain(int argc, char** argv,
+                          const std::vector<PredictorFactory>& makeCandidates) {
+  HalvingOptions options;
+  // Remove the options of successive halving
+  // before parsing the common ones.
+  std::vector<char*> commonArgs;
+  for (int i = 0; i < argc; ++i) {
+    char* endptr;
+    if (strncmp(argv[i], "--first-rung=", 13) == 0) {
+      options.firstRungInstrs = strtoll(argv[i] + 13, &endptr, 0);
+      if (*endptr != '\0' || options.firstRungInstrs < 1) {
+        std::cerr << "--first-rung must be a positive integer\n";
+        return ERR_INPUT_DATA;
+      }
+    } else if (strncmp(argv[i], "--rung-growth=", 14) == 0) {
+      options.rungGrowth = strtod(argv[i] + 14, &endptr);
+      if (*endptr != '\0' || !(options.rungGrowth > 1)) {
+        std::cerr << "--rung-growth must be a number greater than 1\n";
+        return ERR_INPUT_DATA;
+      }
+    } else if (strncmp(argv[i], "--keep-fraction=", 16) == 0) {
+      options.keepFraction = strtod(argv[i] + 16, &endptr);
+      if (*endptr != '\0' ||
+          !(options.keepFraction > 0 && options.keepFraction <= 1)) {
+        std::cerr << "--keep-fraction must be a number in (0, 1]\n";
+        return ERR_INPUT_DATA;
+      }
+    } else if (strncmp(argv[i], "--min-survivors=", 16) == 0) {
+      long long minSurvivors = strtoll(argv[i] + 16, &endptr, 0);
+      if (*endptr != '\0' || minSurvivors < 1) {
+        std::cerr << "--min-survivors must be a positive integer\n";
+        return ERR_INPUT_DATA;
+      }
+      options.minSurvivors = minSurvivors;
+    } else {
+      commonArgs.push_back(argv[i]);
+    }
+  }
+  SimArgs args = ParseCmdLineArgs(commonArgs.size(), commonArgs.data());
+  return detail::PrintReport(SuccessiveHalving(makeCandidates, args, options),
+                             args);
+}
+
+}  // namespace mbp
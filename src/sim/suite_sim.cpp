@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "mbp/sim/simulator.hpp"
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+/**
+ * Calls task(i) for i in [0, numTasks) on a pool of numThreads threads.
+ *
+ * The tasks are dealt among the threads beforehand.
+ * Each thread runs its own tasks in order
+ * and, when it runs out of them, steals the last ones of other threads.
+ */
+template <typename F>
+static void RunWorkStealing(size_t numTasks, int numThreads, F&& task) {
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+  std::vector<TaskQueue> queues(numThreads);
+  for (size_t i = 0; i < numTasks; ++i) {
+    queues[i % numThreads].tasks.push_back(i);
+  }
+  auto work = [&](int self) {
+    while (true) {
+      bool found = false;
+      size_t next;
+      // Try the own queue first and then the others, round-robin.
+      for (int k = 0; k < numThreads && !found; ++k) {
+        TaskQueue& queue = queues[(self + k) % numThreads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        found = true;
+        if (k == 0) {
+          next = queue.tasks.front();
+          queue.tasks.pop_front();
+        } else {
+          next = queue.tasks.back();
+          queue.tasks.pop_back();
+        }
+      }
+      // No tasks are added after the start, so the pool is done.
+      if (!found) return;
+      task(next);
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(numThreads);
+  for (int t = 0; t < numThreads; ++t) workers.emplace_back(work, t);
+  for (std::thread& worker : workers) worker.join();
+}
+
+json SuiteSim(const std::vector<std::string>& traces,
+              const std::vector<PredictorFactory>& makePredictors,
+              const SimArgs& args, size_t groupSize) {
+  if (groupSize == 0 || groupSize > makePredictors.size()) {
+    groupSize = std::max<size_t>(makePredictors.size(), 1);
+  }
+  size_t numGroups = (makePredictors.size() + groupSize - 1) / groupSize;
+  size_t numTasks = traces.size() * numGroups;
+  int numThreads = std::max(1, std::min<int>(args.threads, numTasks));
+  // Results of ParallelSim of each task, or whether it failed and why.
+  std::vector<json> taskResults(numTasks);
+  std::vector<char> taskFailed(numTasks);
+  std::vector<std::string> taskErrors(numTasks);
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  RunWorkStealing(numTasks, numThreads, [&](size_t task) {
+    size_t traceIdx = task / numGroups;
+    size_t groupIdx = task % numGroups;
+    size_t first = groupIdx * groupSize;
+    size_t last = std::min(first + groupSize, makePredictors.size());
+    SimArgs taskArgs = args;
+    taskArgs.tracepath = traces[traceIdx];
+    // The parallelism is in the pool.
+    taskArgs.threads = 1;
+    try {
+      std::vector<std::unique_ptr<Predictor>> predictors;
+      std::vector<Predictor*> predictorPtrs;
+      for (size_t i = first; i < last; ++i) {
+        predictors.emplace_back(makePredictors[i]());
+        predictorPtrs.push_back(predictors.back().get());
+      }
+      taskResults[task] = ParallelSim(predictorPtrs, taskArgs);
+    } catch (const std::exception& e) {
+      taskFailed[task] = true;
+      taskErrors[task] = e.what();
+    } catch (...) {
+      taskFailed[task] = true;
+      taskErrors[task] = "Unknown exception";
+    }
+  });
+  auto endTime = std::chrono::high_resolution_clock::now();
+  double simulationTime =
+      std::chrono::duration<double>(endTime - startTime).count();
+
+  std::vector<json> tracesJson;
+  tracesJson.reserve(traces.size());
+  std::vector<std::string> allErrors;
+  for (size_t traceIdx = 0; traceIdx < traces.size(); ++traceIdx) {
+    json traceJson = {{"trace", traces[traceIdx]}};
+    json results = json::array();
+    std::vector<std::string> errors;
+    double traceSimulationTime = 0;
+    for (size_t groupIdx = 0; groupIdx < numGroups; ++groupIdx) {
+      size_t task = traceIdx * numGroups + groupIdx;
+      if (taskFailed[task]) {
+        // Usually all the groups fail for the same reason.
+        if (std::find(errors.begin(), errors.end(), taskErrors[task]) ==
+            errors.end()) {
+          errors.push_back(taskErrors[task]);
+        }
+        continue;
+      }
+      const json& taskResult = taskResults[task];
+      if (!traceJson.contains("metadata")) {
+        // All the groups read the same instructions of the trace.
+        traceJson["metadata"] = taskResult["metadata"];
+        for (const auto& error : taskResult["errors"]) {
+          errors.push_back(error);
+        }
+      }
+      traceSimulationTime += taskResult["simulation_time"].get<double>();
+      for (const auto& result : taskResult["results"]) {
+        results.push_back(result);
+      }
+    }
+    for (const auto& error : errors) {
+      allErrors.push_back(traces[traceIdx] + ": " + error);
+    }
+    traceJson["simulation_time"] = traceSimulationTime;
+    traceJson["results"] = std::move(results);
+    traceJson["errors"] = errors;
+    tracesJson.emplace_back(std::move(traceJson));
+  }
+
+  json j = {
+      {"metadata",
+       {
+           {"simulator", "MBPlib suite simulate"},
+           {"simulator_version", "v0.1.0"},
+           {"warmup_instr", args.warmupInstrs},
+           {"simulation_instr", args.simInstr},
+           {"num_traces", traces.size()},
+           {"num_predictors", makePredictors.size()},
+           {"group_size", groupSize},
+           {"num_threads", numThreads},
+       }},
+      {"simulation_time", simulationTime},
+      {"traces", tracesJson},
+      {"errors", allErrors},
+  };
+  return j;
+}
+
+static void PrintSuiteUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [<options>] <trace>...\n";
+  std::cerr << "Options:\n";
+  std::cerr << "  --trace-list=<file>     Also simulate the traces listed in "
+               "file, one per line\n";
+  std::cerr << "  --warmup-instr=<instr>  Instructions of warmup (default: "
+               "0)\n";
+  std::cerr << "  --sim-instr=<instr>     Instructions simulated after the "
+               "warmup (default: all)\n";
+  std::cerr << "  --threads=<n>           Size of the thread pool (default: "
+               "hardware threads)\n";
+  std::cerr << "  --group-size=<n>        Predictors simulated together on "
+               "each trace (default: all)\n";
+  std::cerr << "  --prefetch              Decompress the traces in background "
+               "threads\n";
+  std::cerr << "  --format=<format>       Print the output as json (default), "
+               "or as records in ndjson, cbor or msgpack\n";
+}
+
+/**
+ * Parses a non-negative integer option value not greater than max,
+ * exiting if it is not valid.
+ */
+static int64_t ParseSuiteOption(
+    const char* option, const char* value,
+    int64_t max = std::numeric_limits<int64_t>::max()) {
+  char* endptr;
+  errno = 0;
+  int64_t x = strtoll(value, &endptr, 0);
+  if (errno != 0 || endptr == value || *endptr != '\0' || x < 0 || x > max) {
+    std::cerr << option << " must be a non-negative integer";
+    if (max != std::numeric_limits<int64_t>::max()) {
+      std::cerr << " not greater than " << max;
+    }
+    std::cerr << "\n";
+    exit(ERR_INPUT_DATA);
+  }
+  return x;
+}
+
+int SuiteMain(int argc, char** argv,
+              const std::vector<PredictorFactory>& makePredictors) {
+  std::vector<std::string> traces;
+  SimArgs args;
+  args.warmupInstrs = 0;
+  args.simInstr = 0;
+  args.threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t groupSize = 0;
+  for (int i = 1; i < argc; ++i) {
+    const char* value = std::strchr(argv[i], '=');
+    value = value == nullptr ? "" : value + 1;
+    if (strncmp(argv[i], "--trace-list=", 13) == 0) {
+      std::ifstream list(value);
+      if (!list) {
+        std::cerr << "Cannot open trace list '" << value << "'\n";
+        return ERR_INPUT_DATA;
+      }
+      for (std::string trace; std::getline(list, trace);) {
+        if (!trace.empty()) traces.push_back(trace);
+      }
+    } else if (strncmp(argv[i], "--warmup-instr=", 15) == 0) {
+      args.warmupInstrs = ParseSuiteOption("--warmup-instr", value);
+    } else if (strncmp(argv[i], "--sim-instr=", 12) == 0) {
+      args.simInstr = ParseSuiteOption("--sim-instr", value);
+    } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      int threads = ParseSuiteOption("--threads", value,
+                                     std::numeric_limits<int>::max());
+      args.threads = std::max(1, threads);
+    } else if (strncmp(argv[i], "--group-size=", 13) == 0) {
+      groupSize = ParseSuiteOption("--group-size", value);
+    } else if (strcmp(argv[i], "--prefetch") == 0) {
+      args.prefetch = true;
+    } else if (strncmp(argv[i], "--format=", 9) == 0) {
+      if (!detail::ParseOutputFormat(value, args.outputFormat)) {
+        std::cerr << "--format must be json, ndjson, cbor or msgpack\n";
+        return ERR_INPUT_DATA;
+      }
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      std::cerr << "Unknown option '" << argv[i] << "'\n";
+      PrintSuiteUsage(argv[0]);
+      return ERR_INPUT_DATA;
+    } else {
+      traces.push_back(argv[i]);
+    }
+  }
+  if (traces.empty()) {
+    PrintSuiteUsage(argv[0]);
+    return ERR_INPUT_DATA;
+  }
+  if (args.simInstr != 0) {
+    args.stopAtInstr = args.warmupInstrs + args.simInstr;
+  } else {
+    args.stopAtInstr = std::numeric_limits<int64_t>::max();
+  }
+  return detail::PrintReport(SuiteSim(traces, makePredictors, args, groupSize),
+                             args);
+}
+
+}  // namespace mbp
@@ -0,0 +1,209 @@
+#include "mbp/sim/synthetic_trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "nlohmann/json.hpp"
+
+namespace mbp {
+
+// Maximum number of branches in the body of a loop, besides its own.
+static constexpr int MAX_LOOP_BODY = 8;
+// Maximum number of branches skipped by the rest of taken branches.
+static constexpr int MAX_FORWARD_SKIP = 3;
+// Maximum number of instructions between branches in the SBBT format.
+static constexpr int64_t MAX_INSTR_GAP = (1 << 12) - 1;
+
+SyntheticTrace::SyntheticTrace(const SyntheticTraceOptions& options)
+    : options_(options),
+      rng_(options.seed),
+      next_(0),
+      instrNum_(0),
+      history_(0) {
+  if (options.numFunctions < 1 ||
+      options.numStaticBranches < 2 * options.numFunctions) {
+    throw std::invalid_argument(
+        "SyntheticTrace: numFunctions must be positive and "
+        "numStaticBranches at least twice numFunctions");
+  }
+  if (options.callFraction < 0 || options.loopFraction < 0 ||
+      options.correlatedFraction < 0 ||
+      options.callFraction + options.loopFraction +
+              options.correlatedFraction >
+          1) {
+    throw std::invalid_argument(
+        "SyntheticTrace: callFraction, loopFraction and correlatedFraction "
+        "must be non-negative and add up to at most 1");
+  }
+  if (options.indirectFraction < 0 || options.indirectFraction > 1 ||
+      options.maxIndirectTargets < 1) {
+    throw std::invalid_argument(
+        "SyntheticTrace: indirectFraction must be between 0 and 1 "
+        "and maxIndirectTargets positive");
+  }
+  if (options.maxTripCount < 2) {
+    throw std::invalid_argument("SyntheticTrace: maxTripCount must be >= 2");
+  }
+  if (options.correlationDepth < 2 || options.correlationDepth > 64) {
+    throw std::invalid_argument(
+        "SyntheticTrace: correlationDepth must be between 2 and 64");
+  }
+  if (options.minBias < 0.5 || options.minBias > 1) {
+    throw std::invalid_argument(
+        "SyntheticTrace: minBias must be between 0.5 and 1");
+  }
+  if (!(options.instrPerBranch >= 1)) {
+    throw std::invalid_argument("SyntheticTrace: instrPerBranch must be >= 1");
+  }
+
+  int n = options.numStaticBranches;
+  int numFunctions = options.numFunctions;
+  for (int f = 0; f < numFunctions; ++f) {
+    functionStart_.push_back(static_cast<int64_t>(f) * n / numFunctions);
+  }
+  branches_.resize(n);
+  for (int f = 0; f < numFunctions; ++f) {
+    int start = functionStart_[f];
+    int end = (f + 1 < numFunctions ? functionStart_[f + 1] : n) - 1;
+    // Returns to the caller, or restarts the program.
+    branches_[end] = {f == 0 ? Kind::RESTART : Kind::RETURN, start, 0, 0, 0, 0};
+    int lastLoop = start - 1;
+    for (int i = start; i < end; ++i) {
+      StaticBranch& s = branches_[i];
+      s = {Kind::BIASED, 0, 0, 0, 0, 0};
+      double kind = uniform();
+      if (kind < options.callFraction && f + 1 < numFunctions) {
+        // Only the functions after this one are called.
+        auto callee = [&] {
+          int g = f + 1 + static_cast<int>(uniform() * (numFunctions - f - 1));
+          return functionStart_[g];
+        };
+        if (uniform() < options.indirectFraction) {
+          s.kind = Kind::INDIRECT_CALL;
+          s.target = indirectTargets_.size();
+          int numTargets =
+              1 + static_cast<int>(uniform() * options.maxIndirectTargets);
+          std::vector<int> targets;
+          for (int t = 0; t < numTargets; ++t) targets.push_back(callee());
+          indirectTargets_.push_back(std::move(targets));
+        } else {
+          s.kind = Kind::CALL;
+          s.target = callee();
+        }
+        continue;
+      }
+      kind -= options.callFraction;
+      if (0 <= kind && kind < options.loopFraction) {
+        s.kind = Kind::LOOP;
+        int maxBody = std::min(MAX_LOOP_BODY, i - lastLoop - 1);
+        s.target = i - static_cast<int>(uniform() * (maxBody + 1));
+        s.param = 2 + static_cast<int>(uniform() * (options.maxTripCount - 1));
+        lastLoop = i;
+      } else if (0 <= kind && kind < options.loopFraction +
+                                         options.correlatedFraction) {
+        s.kind = Kind::CORRELATED;
+        s.lag0 = uniform() * options.correlationDepth;
+        s.lag1 = uniform() * (options.correlationDepth - 1);
+        if (s.lag1 >= s.lag0) ++s.lag1;
+      } else {
+        s.param = options.minBias + uniform() * (1 - options.minBias);
+        if (uniform() < 0.5) s.param = 1 - s.param;
+      }
+    }
+    // Forward branches do not jump over loops,
+    // so that loops are always left through their last iteration.
+    int nextStop = end;
+    for (int i = end - 1; i >= start; --i) {
+      StaticBranch& s = branches_[i];
+      if (s.kind == Kind::LOOP) {
+        nextStop = i;
+      } else if (s.kind == Kind::BIASED || s.kind == Kind::CORRELATED) {
+        int skip = 1 + static_cast<int>(uniform() * MAX_FORWARD_SKIP);
+        s.target = std::min(i + 1 + skip, nextStop);
+      }
+    }
+  }
+}
+
+int64_t SyntheticTrace::nextBranch(Branch& b) {
+  StaticBranch& s = branches_[next_];
+  bool taken = true;
+  int target = s.target;
+  auto opcode = static_cast<Branch::OpCode>(Branch::CND | Branch::JUMP);
+  switch (s.kind) {
+    case Kind::BIASED:
+      taken = uniform() < s.param;
+      break;
+    case Kind::LOOP:
+      taken = ++s.iteration < s.param;
+      if (!taken) s.iteration = 0;
+      break;
+    case Kind::CORRELATED:
+      taken = ((history_ >> s.lag0) ^ (history_ >> s.lag1)) & 1;
+      break;
+    case Kind::CALL:
+      opcode = Branch::CALL;
+      returnStack_.push_back(next_ + 1);
+      break;
+    case Kind::INDIRECT_CALL: {
+      opcode = static_cast<Branch::OpCode>(Branch::CALL | Branch::IND);
+      // The target depends on the last outcomes.
+      const std::vector<int>& targets = indirectTargets_[s.target];
+      target = targets[history_ % targets.size()];
+      returnStack_.push_back(next_ + 1);
+      break;
+    }
+    case Kind::RETURN:
+      opcode = static_cast<Branch::OpCode>(Branch::RET | Branch::IND);
+      target = returnStack_.back();
+      returnStack_.pop_back();
+      break;
+    case Kind::RESTART:
+      opcode = Branch::JUMP;
+      break;
+  }
+  if (opcode & Branch::CND) history_ = history_ << 1 | taken;
+
+  // The instructions between branches follow a geometric distribution.
+  int64_t gap = 1;
+  if (options_.instrPerBranch > 1) {
+    double p = 1 / options_.instrPerBranch;
+    gap += static_cast<int64_t>(std::log(1 - uniform()) / std::log(1 - p));
+  }
+  instrNum_ += std::min(gap, MAX_INSTR_GAP);
+
+  b = Branch{address(next_), address(target), opcode, taken,
+             static_cast<uint32_t>(next_)};
+  // Conditional branches are never the last of a function.
+  next_ = taken ? target : next_ + 1;
+  return instrNum_;
+}
+
+json SyntheticTrace::metadata() const {
+  return {
+      {"seed", options_.seed},
+      {"num_static_branches", options_.numStaticBranches},
+      {"num_functions", options_.numFunctions},
+      {"call_fraction", options_.callFraction},
+      {"indirect_fraction", options_.indirectFraction},
+      {"max_indirect_targets", options_.maxIndirectTargets},
+      {"loop_fraction", options_.loopFraction},
+      {"max_trip_count", options_.maxTripCount},
+      {"correlated_fraction", options_.correlatedFraction},
+      {"correlation_depth", options_.correlationDepth},
+      {"min_bias", options_.minBias},
+      {"instr_per_branch", options_.instrPerBranch},
+  };
+}
+
+double SyntheticTrace::uniform() {
+  // The 53 most significant bits fill the mantissa of a double.
+  return (rng_() >> 11) * 0x1.0p-53;
+}
+
+uint64_t SyntheticTrace::address(int idx) {
+  return 0x400000 + 32 * static_cast<uint64_t>(idx);
+}
+
+}  // namespace mbp
@@ -0,0 +1,527 @@
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef MBPLIB_HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef MBPLIB_HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+#ifdef MBPLIB_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MBPLIB_HAVE_LIBLZ4
+#include <lz4frame.h>
+#endif
+
+#include "trace_source.hpp"
+
+namespace mbp {
+
+namespace {
+
+/**
+ * Source reading from a stdio stream, which can be a file or a pipe.
+ */
+class StdioSource : public TraceSource {
+ public:
+  StdioSource(FILE* stream, bool isPipe) : stream_(stream), isPipe_(isPipe) {}
+
+  ~StdioSource() override {
+    if (isPipe_) {
+      pclose(stream_);
+    } else {
+      fclose(stream_);
+    }
+  }
+
+  size_t read(char* dst, size_t n) override {
+    size_t len = std::fread(dst, sizeof(char), n, stream_);
+    if (std::ferror(stream_)) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+    return len;
+  }
+
+  bool eof() const override { return std::feof(stream_); }
+
+  bool seekable() const override { return !isPipe_; }
+
+  void seek(uint64_t offset) override {
+    if (fseeko(stream_, offset, SEEK_SET) != 0) {
+      throw std::system_error(errno, std::generic_category(), "fseek failed");
+    }
+  }
+
+ private:
+  FILE* stream_;
+  bool isPipe_;
+};
+
+[[maybe_unused]] std::unique_ptr<TraceSource> OpenPipe(const std::string& cmd,
+                                                      const char* tool) {
+  FILE* pipe = popen(cmd.c_str(), "r");
+  if (pipe == nullptr) {
+    throw std::system_error(errno, std::generic_category(),
+                            std::string(tool) + " popen failed");
+  }
+  return std::make_unique<StdioSource>(pipe, true);
+}
+
+FILE* OpenFile(const std::string& trace) {
+  FILE* file = fopen(trace.c_str(), "r");
+  if (file == nullptr) {
+    throw std::system_error(errno, std::generic_category(), "fopen failed");
+  }
+  return file;
+}
+
+/**
+ * Base class for the sources that decompress a file in-process.
+ *
+ * It owns the compressed file and a buffer of compressed input.
+ * Derived classes decompress directly into the destination of read().
+ */
+class CompressedFileSource : public TraceSource {
+ public:
+  // Size of the reads of compressed data.
+  static constexpr size_t INPUT_SIZE = 1 << 17;
+
+  CompressedFileSource(const std::string& trace)
+      : file_(OpenFile(trace)),
+        input_(INPUT_SIZE),
+        inputStart_(0),
+        inputEnd_(0),
+        eof_(false) {}
+
+  ~CompressedFileSource() override { fclose(file_); }
+
+  bool eof() const override { return eof_; }
+
+ protected:
+  /**
+   * Reads more compressed data if all the previous data was consumed.
+   *
+   * @return false if there is no more compressed data.
+   */
+  bool fillInput() {
+    if (inputStart_ < inputEnd_) return true;
+    inputStart_ = 0;
+    inputEnd_ = std::fread(input_.data(), sizeof(char), INPUT_SIZE, file_);
+    if (std::ferror(file_)) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+    return inputEnd_ != 0;
+  }
+
+  /**
+   * Moves the compressed file to offset and discards the buffered input.
+   */
+  void seekFile(uint64_t offset) {
+    if (fseeko(file_, offset, SEEK_SET) != 0) {
+      throw std::system_error(errno, std::generic_category(), "fseek failed");
+    }
+    inputStart_ = 0;
+    inputEnd_ = 0;
+    eof_ = false;
+  }
+
+  FILE* file_;
+  std::vector<char> input_;
+  size_t inputStart_;
+  size_t inputEnd_;
+  bool eof_;
+};
+
+#ifdef MBPLIB_HAVE_LIBZSTD
+class ZstdSource : public CompressedFileSource {
+ public:
+  ZstdSource(const std::string& trace)
+      : CompressedFileSource(trace), dstream_(ZSTD_createDStream()) {
+    if (dstream_ == nullptr) {
+      throw std::runtime_error("SbbtReader: ZSTD_createDStream failed");
+    }
+  }
+
+  ~ZstdSource() override { ZSTD_freeDStream(dstream_); }
+
+  size_t read(char* dst, size_t n) override {
+    ZSTD_outBuffer out{dst, n, 0};
+    while (out.pos < out.size && !eof_) {
+      bool moreInput = fillInput();
+      ZSTD_inBuffer in{input_.data(), inputEnd_, inputStart_};
+      size_t produced = out.pos;
+      size_t ret = ZSTD_decompressStream(dstream_, &out, &in);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error(std::string("SbbtReader: zstd error: ") +
+                                 ZSTD_getErrorName(ret));
+      }
+      if (in.pos != inputStart_ || out.pos != produced) {
+        // A return value of 0 means that a frame was completed.
+        frameComplete_ = ret == 0;
+      }
+      inputStart_ = in.pos;
+      if (!moreInput && out.pos == produced) {
+        if (!frameComplete_) {
+          throw std::runtime_error("SbbtReader: truncated zstd trace");
+        }
+        eof_ = true;
+      }
+    }
+    return out.pos;
+  }
+
+  // Each frame of a zstd trace can be decompressed independently.
+  bool seekable() const override { return true; }
+
+  void seek(uint64_t offset) override {
+    seekFile(offset);
+    ZSTD_DCtx_reset(dstream_, ZSTD_reset_session_only);
+    frameComplete_ = false;
+  }
+
+ private:
+  ZSTD_DStream* dstream_;
+  bool frameComplete_ = false;
+};
+#endif  // MBPLIB_HAVE_LIBZSTD
+
+#ifdef MBPLIB_HAVE_LIBLZMA
+class XzSource : public CompressedFileSource {
+ public:
+  XzSource(const std::string& trace)
+      : CompressedFileSource(trace), stream_(LZMA_STREAM_INIT) {
+    lzma_ret ret =
+        lzma_stream_decoder(&stream_, UINT64_MAX, LZMA_CONCATENATED);
+    if (ret != LZMA_OK) {
+      throw std::runtime_error("SbbtReader: lzma_stream_decoder failed");
+    }
+  }
+
+  ~XzSource() override { lzma_end(&stream_); }
+
+  size_t read(char* dst, size_t n) override {
+    stream_.next_out = reinterpret_cast<uint8_t*>(dst);
+    stream_.avail_out = n;
+    while (stream_.avail_out > 0 && !eof_) {
+      bool moreInput = fillInput();
+      stream_.next_in =
+          reinterpret_cast<const uint8_t*>(input_.data() + inputStart_);
+      stream_.avail_in = inputEnd_ - inputStart_;
+      // With LZMA_CONCATENATED, the end of the input must be signaled.
+      lzma_ret ret = lzma_code(&stream_, moreInput ? LZMA_RUN : LZMA_FINISH);
+      inputStart_ = inputEnd_ - stream_.avail_in;
+      if (ret == LZMA_STREAM_END) {
+        eof_ = true;
+      } else if (ret == LZMA_BUF_ERROR && !moreInput) {
+        throw std::runtime_error("SbbtReader: truncated xz trace");
+      } else if (ret != LZMA_OK) {
+        throw std::runtime_error("SbbtReader: xz error " +
+                                 std::to_string(ret));
+      }
+    }
+    return n - stream_.avail_out;
+  }
+
+ private:
+  lzma_stream stream_;
+};
+#endif  // MBPLIB_HAVE_LIBLZMA
+
+#ifdef MBPLIB_HAVE_ZLIB
+class GzipSource : public CompressedFileSource {
+ public:
+  GzipSource(const std::string& trace) : CompressedFileSource(trace) {
+    stream_ = {};
+    // 15 is the maximum window size and +16 selects the gzip format.
+    if (inflateInit2(&stream_, 15 + 16) != Z_OK) {
+      throw std::runtime_error("SbbtReader: inflateInit2 failed");
+    }
+  }
+
+  ~GzipSource() override { inflateEnd(&stream_); }
+
+  size_t read(char* dst, size_t n) override {
+    stream_.next_out = reinterpret_cast<Bytef*>(dst);
+    stream_.avail_out = n;
+    while (stream_.avail_out > 0 && !eof_) {
+      bool moreInput = fillInput();
+      stream_.next_in = reinterpret_cast<Bytef*>(input_.data() + inputStart_);
+      stream_.avail_in = inputEnd_ - inputStart_;
+      uInt produced = stream_.avail_out;
+      int ret = inflate(&stream_, Z_NO_FLUSH);
+      inputStart_ = inputEnd_ - stream_.avail_in;
+      if (ret == Z_STREAM_END) {
+        // Like gzip, continue with the next member, if there is one.
+        memberEnded_ = true;
+        inflateReset(&stream_);
+      } else if (ret == Z_OK) {
+        memberEnded_ = false;
+      } else if (ret != Z_BUF_ERROR) {
+        throw std::runtime_error("SbbtReader: gzip error " +
+                                 std::to_string(ret));
+      }
+      if (!moreInput && stream_.avail_out == produced) {
+        if (!memberEnded_) {
+          throw std::runtime_error("SbbtReader: truncated gzip trace");
+        }
+        eof_ = true;
+      }
+    }
+    return n - stream_.avail_out;
+  }
+
+ private:
+  z_stream stream_;
+  bool memberEnded_ = false;
+};
+#endif  // MBPLIB_HAVE_ZLIB
+
+#ifdef MBPLIB_HAVE_LIBLZ4
+class Lz4Source : public CompressedFileSource {
+ public:
+  Lz4Source(const std::string& trace) : CompressedFileSource(trace) {
+    size_t ret = LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION);
+    if (LZ4F_isError(ret)) {
+      throw std::runtime_error(
+          "SbbtReader: LZ4F_createDecompressionContext failed");
+    }
+  }
+
+  ~Lz4Source() override { LZ4F_freeDecompressionContext(dctx_); }
+
+  size_t read(char* dst, size_t n) override {
+    size_t produced = 0;
+    while (produced < n && !eof_) {
+      bool moreInput = fillInput();
+      size_t dstSize = n - produced;
+      size_t srcSize = inputEnd_ - inputStart_;
+      size_t ret = LZ4F_decompress(dctx_, dst + produced, &dstSize,
+                                   input_.data() + inputStart_, &srcSize,
+                                   nullptr);
+      if (LZ4F_isError(ret)) {
+        throw std::runtime_error(std::string("SbbtReader: lz4 error: ") +
+                                 LZ4F_getErrorName(ret));
+      }
+      if (srcSize != 0 || dstSize != 0) {
+        // A return value of 0 means that a frame was completed.
+        frameComplete_ = ret == 0;
+      }
+      produced += dstSize;
+      inputStart_ += srcSize;
+      if (!moreInput && dstSize == 0) {
+        if (!frameComplete_) {
+          throw std::runtime_error("SbbtReader: truncated lz4 trace");
+        }
+        eof_ = true;
+      }
+    }
+    return produced;
+  }
+
+ private:
+  LZ4F_dctx* dctx_;
+  bool frameComplete_ = false;
+};
+#endif  // MBPLIB_HAVE_LIBLZ4
+
+/**
+ * Source that reads ahead from another source in a background thread.
+ *
+ * The producer thread fills a ring of chunks in order
+ * and the consumer copies from them as it reads.
+ * A chunk is only handed to the producer again once it has been consumed.
+ */
+class PrefetchSource : public TraceSource {
+ public:
+  static constexpr size_t NUM_CHUNKS = 4;
+  static constexpr size_t CHUNK_SIZE = 1 << 22;
+
+  PrefetchSource(std::unique_ptr<TraceSource> source)
+      : source_(std::move(source)),
+        chunks_(NUM_CHUNKS),
+        readIdx_(0),
+        readPos_(0),
+        eof_(false),
+        stop_(false) {
+    for (auto& chunk : chunks_) chunk.data.resize(CHUNK_SIZE);
+    producer_ = std::thread(&PrefetchSource::produce, this);
+  }
+
+  ~PrefetchSource() override { stopProducer(); }
+
+  size_t read(char* dst, size_t n) override {
+    size_t copied = 0;
+    while (copied < n && !eof_) {
+      Chunk& chunk = chunks_[readIdx_];
+      if (readPos_ == 0) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        chunkProduced_.wait(lock, [&chunk] { return chunk.full; });
+        if (chunk.error) std::rethrow_exception(chunk.error);
+      }
+      size_t len = std::min(n - copied, chunk.size - readPos_);
+      memcpy(dst + copied, chunk.data.data() + readPos_, len);
+      copied += len;
+      readPos_ += len;
+      if (readPos_ == chunk.size) {
+        eof_ = chunk.last;
+        readPos_ = 0;
+        readIdx_ = (readIdx_ + 1) % NUM_CHUNKS;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          chunk.full = false;
+        }
+        chunkConsumed_.notify_one();
+      }
+    }
+    return copied;
+  }
+
+  bool eof() const override { return eof_; }
+
+  bool seekable() const override { return source_->seekable(); }
+
+  void seek(uint64_t offset) override {
+    // The chunks read ahead are discarded and the producer starts again.
+    stopProducer();
+    source_->seek(offset);
+    for (auto& chunk : chunks_) {
+      chunk.full = false;
+      chunk.last = false;
+      chunk.error = nullptr;
+    }
+    readIdx_ = 0;
+    readPos_ = 0;
+    eof_ = false;
+    stop_ = false;
+    producer_ = std::thread(&PrefetchSource::produce, this);
+  }
+
+ private:
+  struct Chunk {
+    std::vector<char> data;
+    size_t size = 0;
+    // Whether the chunk is ready for the consumer.
+    bool full = false;
+    // Whether this is the last chunk of the stream.
+    bool last = false;
+    std::exception_ptr error;
+  };
+
+  void stopProducer() {
+    if (!producer_.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    chunkConsumed_.notify_one();
+    producer_.join();
+  }
+
+  void produce() {
+    for (size_t idx = 0;; idx = (idx + 1) % NUM_CHUNKS) {
+      Chunk& chunk = chunks_[idx];
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        chunkConsumed_.wait(lock, [&] { return !chunk.full || stop_; });
+        if (stop_) return;
+      }
+      // Only this thread accesses a chunk that is not full.
+      chunk.size = 0;
+      try {
+        while (chunk.size < CHUNK_SIZE && !source_->eof()) {
+          chunk.size += source_->read(chunk.data.data() + chunk.size,
+                                      CHUNK_SIZE - chunk.size);
+        }
+        chunk.last = source_->eof();
+      } catch (...) {
+        chunk.error = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        chunk.full = true;
+      }
+      chunkProduced_.notify_one();
+      if (chunk.last || chunk.error) return;
+    }
+  }
+
+  std::unique_ptr<TraceSource> source_;
+  std::vector<Chunk> chunks_;
+  // Consumer state.
+  size_t readIdx_;
+  size_t readPos_;
+  bool eof_;
+  // Shared state.
+  std::mutex mutex_;
+  std::condition_variable chunkProduced_;
+  std::condition_variable chunkConsumed_;
+  bool stop_;
+  std::thread producer_;
+};
+
+}  // namespace
+
+std::unique_ptr<TraceSource> MakePrefetchSource(
+    std::unique_ptr<TraceSource> source) {
+  return std::make_unique<PrefetchSource>(std::move(source));
+}
+
+std::unique_ptr<TraceSource> OpenTraceSource(const std::string& trace) {
+  // The trace can be either uncompressed...
+  size_t last_dot = trace.find_last_of('.');
+  // Note: we check that last_dot != 0 because we will write last_dot-1.
+  if (last_dot == trace.npos || last_dot == 0) {
+    throw std::invalid_argument("SbbtReader: file '" + trace +
+                                "' does not have extension.");
+  }
+  std::string extension = trace.substr(last_dot);
+  if (extension == ".sbbt") {
+    return std::make_unique<StdioSource>(OpenFile(trace), false);
+  }
+  // Or compressed using a variety of tools: gzip, xz, zstd or lz4.
+  last_dot = trace.find_last_of('.', last_dot - 1);
+  if (last_dot == trace.npos) {
+    throw std::invalid_argument("SbbtReader: cannot recognize file type of '" +
+                                trace + "'.");
+  }
+  extension = trace.substr(last_dot);
+  if (extension == ".sbbt.xz") {
+#ifdef MBPLIB_HAVE_LIBLZMA
+    return std::make_unique<XzSource>(trace);
+#else
+    return OpenPipe("xz --decompress --keep --stdout " + trace, "xz");
+#endif
+  } else if (extension == ".sbbt.zst") {
+#ifdef MBPLIB_HAVE_LIBZSTD
+    return std::make_unique<ZstdSource>(trace);
+#else
+    return OpenPipe("zstd --decompress --stdout --quiet " + trace, "zstd");
+#endif
+  } else if (extension == ".sbbt.lz4") {
+#ifdef MBPLIB_HAVE_LIBLZ4
+    return std::make_unique<Lz4Source>(trace);
+#else
+    return OpenPipe("lz4 --decompress --stdout --quiet " + trace, "lz4");
+#endif
+  } else if (extension == ".sbbt.gz") {
+#ifdef MBPLIB_HAVE_ZLIB
+    return std::make_unique<GzipSource>(trace);
+#else
+    return OpenPipe("gzip --decompress --stdout --keep " + trace, "gzip");
+#endif
+  }
+  throw std::invalid_argument("SbbtReader: File type of '" + trace +
+                              "' not supported.");
+}
+
+}  // namespace mbp
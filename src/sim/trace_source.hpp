@@ -0,0 +1,72 @@
+#ifndef MBP_TRACE_SOURCE_HPP_
+#define MBP_TRACE_SOURCE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace mbp {
+
+/**
+ * Stream of (decompressed) trace bytes.
+ *
+ * This is the interface used by SbbtReader to fill its buffer,
+ * regardless of how the trace file is stored.
+ */
+class TraceSource {
+ public:
+  virtual ~TraceSource() = default;
+
+  /**
+   * Reads up to n bytes into dst and returns the number of bytes read.
+   *
+   * Fewer than n bytes may be returned even if the stream is not finished.
+   */
+  virtual size_t read(char* dst, size_t n) = 0;
+
+  /**
+   * Tells whether the end of the stream has been reached.
+   */
+  virtual bool eof() const = 0;
+
+  /**
+   * Tells whether seek() is supported.
+   */
+  virtual bool seekable() const { return false; }
+
+  /**
+   * Moves the stream to an offset of the trace file.
+   *
+   * For compressed traces, the offset must be the start of a frame
+   * whose decompressed data starts the rest of the stream.
+   * Must only be called if the source is seekable.
+   */
+  virtual void seek(uint64_t offset) {
+    throw std::logic_error("TraceSource: seek is not supported");
+  }
+};
+
+/**
+ * Opens a trace source for the given file according to its extension.
+ *
+ * Supported extensions are .sbbt, .sbbt.zst, .sbbt.xz, .sbbt.gz and .sbbt.lz4.
+ * Compressed traces are decompressed in-process
+ * if MBPlib was configured with the corresponding library,
+ * or through a pipe from the command line utility otherwise.
+ */
+std::unique_ptr<TraceSource> OpenTraceSource(const std::string& trace);
+
+/**
+ * Wraps a source so that it is read by a background thread.
+ *
+ * The thread reads ahead into a ring of large chunks,
+ * overlapping the decompression of the trace with its consumption.
+ */
+std::unique_ptr<TraceSource> MakePrefetchSource(
+    std::unique_ptr<TraceSource> source);
+
+}  // namespace mbp
+
+#endif  // MBP_TRACE_SOURCE_HPP_